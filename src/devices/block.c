@@ -1,6 +1,9 @@
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include <blockstat.h>
 #include <list.h>
 #include <stdio.h>
 #include <string.h>
@@ -17,8 +20,17 @@ struct block
   const struct block_operations *ops; /* Driver operations. */
   void *aux;                          /* Extra data owned by driver. */
 
-  unsigned long long read_cnt;  /* Number of sectors read. */
-  unsigned long long write_cnt; /* Number of sectors written. */
+  /* Statistics, protected by disabling interrupts because
+     requests may complete in interrupt context. */
+  unsigned long long read_cnt;    /* Number of sectors read. */
+  unsigned long long write_cnt;   /* Number of sectors written. */
+  unsigned long long request_cnt; /* Number of requests. */
+  unsigned long long seq_cnt;     /* Number of sequential requests. */
+  block_sector_t next_sector;     /* Sector after the last request. */
+  unsigned in_flight;             /* Requests now outstanding. */
+  unsigned max_depth;             /* Maximum of IN_FLIGHT. */
+  uint32_t wait_hist[BLOCKSTAT_BUCKETS];    /* Wait times. */
+  uint32_t service_hist[BLOCKSTAT_BUCKETS]; /* Service times. */
 };
 
 /* List of all block devices. */
@@ -28,6 +40,10 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void account_completion (struct block *, struct block_request *,
+                                int64_t now);
+static void print_histogram (const char *name, const char *label,
+                             const uint32_t hist[BLOCKSTAT_BUCKETS]);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -115,9 +131,11 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  struct block_request request;
+
+  block_request_init (&request, block, sector, 1, buffer, false, NULL, NULL);
+  block_submit (&request);
+  block_wait (&request);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -128,10 +146,65 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  struct block_request request;
+
+  block_request_init (&request, block, sector, 1, (void *)buffer, true,
+                      NULL, NULL);
+  block_submit (&request);
+  block_wait (&request);
+}
+
+/* Initializes REQUEST to transfer SECTOR_CNT sectors, starting
+   at SECTOR, between BLOCK and BUFFER: from BLOCK into BUFFER if
+   WRITE is false, from BUFFER to BLOCK if WRITE is true.  BUFFER
+   must be in kernel memory.
+
+   If COMPLETE is non-null, it is called with REQUEST, whose aux
+   member is AUX, when the transfer is done.  Otherwise, the
+   caller should wait for the transfer with block_wait(). */
+void
+block_request_init (struct block_request *request, struct block *block,
+                    block_sector_t sector, size_t sector_cnt, void *buffer,
+                    bool write, block_complete_func *complete, void *aux)
+{
+  ASSERT (sector_cnt > 0 && sector_cnt <= BLOCK_REQUEST_MAX);
+  ASSERT (buffer != NULL);
+
+  request->block = block;
+  request->sector = sector;
+  request->sector_cnt = sector_cnt;
+  request->buffer = buffer;
+  request->write = write;
+  request->complete = complete;
+  request->aux = aux;
+  request->hw_block = block;
+  request->hw_sector = sector;
+  request->driver = NULL;
+  request->deadline = 0;
+  request->submit_time = request->dispatch_time = 0;
+  sema_init (&request->done, 0);
+}
+
+/* Starts carrying out REQUEST and returns, usually before the
+   transfer is done.  Requests submitted to a device may complete
+   in any order.
+   May be called in interrupt context only if REQUEST's device
+   supports asynchronous submission. */
+void
+block_submit (struct block_request *request)
+{
+  request->hw_sector = request->sector;
+  request->submit_time = request->dispatch_time = timer_usecs ();
+  block_forward (request->block, request);
+}
+
+/* Waits for REQUEST, which must have been submitted without a
+   completion callback, to complete. */
+void
+block_wait (struct block_request *request)
+{
+  ASSERT (request->complete == NULL);
+  sema_down (&request->done);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -155,6 +228,27 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Stores a snapshot of BLOCK's statistics into *STATS. */
+void
+block_get_stats (struct block *block, struct blockstat *stats)
+{
+  enum intr_level old_level;
+
+  strlcpy (stats->name, block->name, sizeof stats->name);
+  stats->type = block->type;
+
+  old_level = intr_disable ();
+  stats->read_cnt = block->read_cnt;
+  stats->write_cnt = block->write_cnt;
+  stats->request_cnt = block->request_cnt;
+  stats->seq_cnt = block->seq_cnt;
+  stats->max_depth = block->max_depth;
+  memcpy (stats->wait_hist, block->wait_hist, sizeof stats->wait_hist);
+  memcpy (stats->service_hist, block->service_hist,
+          sizeof stats->service_hist);
+  intr_set_level (old_level);
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
@@ -166,13 +260,43 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n", block->name,
-                  block_type_name (block->type), block->read_cnt,
-                  block->write_cnt);
+          struct blockstat stats;
+
+          block_get_stats (block, &stats);
+          printf ("%s (%s): %llu reads, %llu writes\n", stats.name,
+                  block_type_name (stats.type), stats.read_cnt,
+                  stats.write_cnt);
+          if (stats.request_cnt == 0)
+            continue;
+          printf ("%s: %llu requests, %llu sequential, max depth %u\n",
+                  stats.name, stats.request_cnt, stats.seq_cnt,
+                  stats.max_depth);
+          print_histogram (stats.name, "wait", stats.wait_hist);
+          print_histogram (stats.name, "service", stats.service_hist);
         }
     }
 }
 
+/* Prints the nonempty buckets of latency histogram HIST for the
+   device with the given NAME, under the given LABEL. */
+static void
+print_histogram (const char *name, const char *label,
+                 const uint32_t hist[BLOCKSTAT_BUCKETS])
+{
+  int i;
+
+  printf ("%s: %s (us):", name, label);
+  for (i = 0; i < BLOCKSTAT_BUCKETS; i++)
+    if (hist[i] != 0)
+      {
+        if (i < BLOCKSTAT_BUCKETS - 1)
+          printf (" <%lu:%" PRIu32, 1ul << i, hist[i]);
+        else
+          printf (" >=%lu:%" PRIu32, 1ul << (i - 1), hist[i]);
+      }
+  printf ("\n");
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -195,6 +319,13 @@ block_register (const char *name, enum block_type type, const char *extra_info,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = 0;
+  block->seq_cnt = 0;
+  block->next_sector = 0;
+  block->in_flight = 0;
+  block->max_depth = 0;
+  memset (block->wait_hist, 0, sizeof block->wait_hist);
+  memset (block->service_hist, 0, sizeof block->service_hist);
 
   printf ("%s: %'" PRDSNu " sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t)block->size * BLOCK_SECTOR_SIZE);
@@ -206,6 +337,113 @@ block_register (const char *name, enum block_type type, const char *extra_info,
   return block;
 }
 
+/* Passes REQUEST to BLOCK's driver, to be carried out starting
+   at REQUEST's hw_sector within BLOCK.  Used by block_submit()
+   and by drivers, such as the partition driver, that are layered
+   on top of another block device. */
+void
+block_forward (struct block *block, struct block_request *request)
+{
+  enum intr_level old_level;
+
+  check_sector (block, request->hw_sector);
+  check_sector (block, request->hw_sector + request->sector_cnt - 1);
+  ASSERT (!request->write || block->type != BLOCK_FOREIGN);
+
+  old_level = intr_disable ();
+  if (request->write)
+    block->write_cnt += request->sector_cnt;
+  else
+    block->read_cnt += request->sector_cnt;
+  block->request_cnt++;
+  if (request->hw_sector == block->next_sector)
+    block->seq_cnt++;
+  block->next_sector = request->hw_sector + request->sector_cnt;
+  if (++block->in_flight > block->max_depth)
+    block->max_depth = block->in_flight;
+  intr_set_level (old_level);
+
+  request->hw_block = block;
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, request);
+  else
+    {
+      uint8_t *buffer = request->buffer;
+      size_t i;
+
+      block_dispatched (request);
+      for (i = 0; i < request->sector_cnt; i++)
+        if (request->write)
+          block->ops->write (block->aux, request->hw_sector + i,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+        else
+          block->ops->read (block->aux, request->hw_sector + i,
+                            buffer + i * BLOCK_SECTOR_SIZE);
+      block_complete (request);
+    }
+}
+
+/* Called by a block device driver that queues requests when it
+   starts carrying out REQUEST, to separate the time the request
+   spent waiting in the queue from the time spent servicing it. */
+void
+block_dispatched (struct block_request *request)
+{
+  request->dispatch_time = timer_usecs ();
+}
+
+/* Called by a block device driver when it has finished carrying
+   out REQUEST.  Notifies the request's submitter. */
+void
+block_complete (struct block_request *request)
+{
+  int64_t now = timer_usecs ();
+  enum intr_level old_level;
+
+  /* Statistics are kept for the device that the request was
+     submitted to and for the one that serviced it. */
+  old_level = intr_disable ();
+  account_completion (request->block, request, now);
+  if (request->hw_block != request->block)
+    account_completion (request->hw_block, request, now);
+  intr_set_level (old_level);
+
+  if (request->complete != NULL)
+    request->complete (request);
+  else
+    sema_up (&request->done);
+}
+
+/* Returns the histogram bucket for a latency of USECS
+   microseconds. */
+static int
+latency_bucket (int64_t usecs)
+{
+  int bucket = 0;
+
+  while (usecs > 0 && bucket < BLOCKSTAT_BUCKETS - 1)
+    {
+      usecs >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Updates BLOCK's statistics for the completion of REQUEST at
+   time NOW.  Interrupts must be off. */
+static void
+account_completion (struct block *block, struct block_request *request,
+                    int64_t now)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (block->in_flight > 0);
+
+  block->in_flight--;
+  block->wait_hist[latency_bucket (request->dispatch_time
+                                   - request->submit_time)]++;
+  block->service_hist[latency_bucket (now - request->dispatch_time)]++;
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
    pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block *
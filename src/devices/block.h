@@ -1,7 +1,10 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include "threads/synch.h"
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* Size of a block device sector in bytes.
@@ -19,6 +22,9 @@ typedef uint32_t block_sector_t;
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Maximum number of sectors in a single block_request. */
+#define BLOCK_REQUEST_MAX 128
+
 /* Higher-level interface for file systems, etc. */
 
 struct block;
@@ -57,19 +63,75 @@ void block_write (struct block *, block_sector_t, const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+
+struct block_request;
+
+/* Called when REQUEST has completed.  May be called in
+   interrupt context, so it must not sleep. */
+typedef void block_complete_func (struct block_request *request);
+
+/* A request to transfer one or more consecutive sectors between
+   a block device and a buffer in kernel memory.  The request
+   belongs to the block layer and the driver from block_submit()
+   until it completes, so the caller must not modify or free it
+   in the meantime. */
+struct block_request
+{
+  /* Set by block_request_init(). */
+  struct block *block;           /* Block device. */
+  block_sector_t sector;         /* First sector within BLOCK. */
+  size_t sector_cnt;             /* Number of sectors. */
+  void *buffer;                  /* SECTOR_CNT * BLOCK_SECTOR_SIZE bytes. */
+  bool write;                    /* True to write, false to read. */
+  block_complete_func *complete; /* Completion callback, or null. */
+  void *aux;                     /* For use by COMPLETE. */
+
+  /* For use by the block layer and drivers. */
+  struct block *hw_block;   /* Device that actually services it. */
+  block_sector_t hw_sector; /* First sector within HW_BLOCK. */
+  void *driver;             /* Driver-private data. */
+  struct list_elem elem;    /* Element in a driver queue. */
+  int64_t deadline;         /* Timer tick by which to dispatch. */
+  int64_t submit_time;      /* timer_usecs() at submission. */
+  int64_t dispatch_time;    /* timer_usecs() when the driver started. */
+  struct semaphore done;    /* Up'd on completion if COMPLETE is null. */
+};
+
+void block_request_init (struct block_request *, struct block *,
+                         block_sector_t, size_t sector_cnt, void *buffer,
+                         bool write, block_complete_func *, void *aux);
+void block_submit (struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
+struct blockstat;
+void block_get_stats (struct block *, struct blockstat *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* Operations on a block device.  A driver that provides SUBMIT
+   receives every request through it and need not provide READ
+   and WRITE.  Otherwise, requests are carried out synchronously,
+   one sector at a time, through READ and WRITE. */
 struct block_operations
 {
   void (*read) (void *aux, block_sector_t, void *buffer);
   void (*write) (void *aux, block_sector_t, const void *buffer);
+
+  /* Starts carrying out REQUEST beginning at its hw_sector and
+     returns without waiting for it.  The driver must call
+     block_complete() once the transfer is done.  May be called
+     in interrupt context. */
+  void (*submit) (void *aux, struct block_request *);
 };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_forward (struct block *, struct block_request *);
+void block_dispatched (struct block_request *);
+void block_complete (struct block_request *);
 
 #endif /* devices/block.h */
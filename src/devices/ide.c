@@ -1,17 +1,34 @@
 #include "devices/ide.h"
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include <ctype.h>
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Transfers use PCI bus-master DMA when the channel belongs to a
+   bus-master IDE controller (such as the PIIX3/PIIX4 emulated by
+   QEMU and Bochs) and the disk reports DMA support, and fall back
+   to programmed I/O otherwise.
+
+   Block requests are queued per channel and carried out by a
+   dispatcher thread, which is the only thread that touches a
+   channel's registers once its disks have been identified.  The
+   dispatcher picks requests in C-LOOK (one-way elevator) order,
+   except that a request left waiting past its deadline is served
+   first, and merges queued requests for adjacent sectors into a
+   single multi-sector command. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)   /* Data. */
@@ -30,10 +47,18 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206) /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)      /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the base given by
+   BAR4 of the controller.  The secondary channel's registers
+   follow the primary's at offset 8. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -43,12 +68,51 @@
 #define DEV_LBA 0x40 /* Linear based addressing. */
 #define DEV_DEV 0x10 /* Select device: 0=master, 1=slave. */
 
+/* Bus Master Command Register bits. */
+#define BM_CMD_START 0x01 /* Start/stop bus master transfer. */
+#define BM_CMD_READ 0x08  /* Direction: 1=device to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_ACTIVE 0x01 /* Bus master transfer active. */
+#define BM_STA_ERROR 0x02  /* Transfer error, write 1 to clear. */
+#define BM_STA_INTR 0x04   /* Interrupt raised, write 1 to clear. */
+
 /* Commands.
    Many more are defined but this is the small subset that we
    use. */
 #define CMD_IDENTIFY_DEVICE 0xec    /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20  /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8           /* READ DMA with retries. */
+#define CMD_WRITE_DMA 0xca          /* WRITE DMA with retries. */
+
+/* IDENTIFY DEVICE word 49 (capabilities) bits. */
+#define ID_CAP_DMA 0x0100 /* DMA supported. */
+
+/* A physical region descriptor, the unit of a bus master
+   scatter/gather list.  A region must not cross a 64 kB
+   boundary, and a size of 0 means 64 kB. */
+struct prd
+{
+  uint32_t addr;  /* Physical base address of the region. */
+  uint16_t size;  /* Byte count. */
+  uint16_t flags; /* PRD_EOT on the last descriptor in the table. */
+};
+#define PRD_EOT 0x8000 /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd)) /* Entries in a table. */
+
+/* Maximum number of sectors transferred by one command.  Merged
+   requests are at most this long, which also bounds the number
+   of PRDs needed, since each request's buffer may cross at most
+   one 64 kB boundary per 64 kB it contains. */
+#define MAX_TRANSFER BLOCK_REQUEST_MAX
+
+/* Number of timer ticks that a read or write request may wait in
+   the queue before it is dispatched ahead of elevator order.
+   Reads get the shorter deadline because someone is usually
+   waiting for them. */
+#define READ_EXPIRE (TIMER_FREQ / 2)
+#define WRITE_EXPIRE (TIMER_FREQ * 5)
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +121,7 @@ struct ata_disk
   struct channel *channel; /* Channel that disk is attached to. */
   int dev_no;              /* Device 0 or 1 for master or slave. */
   bool is_ata;             /* Is device an ATA disk? */
+  bool use_dma;            /* Transfer with bus master DMA? */
 };
 
 /* An ATA channel (aka controller).
@@ -67,11 +132,21 @@ struct channel
   uint16_t reg_base; /* Base I/O port. */
   uint8_t irq;       /* Interrupt in use. */
 
-  struct lock lock;         /* Must acquire to access the controller. */
   bool expecting_interrupt; /* True if an interrupt is expected, false if
                                any interrupt would be spurious. */
   struct semaphore completion_wait; /* Up'd by interrupt handler. */
 
+  /* Request queue, protected by disabling interrupts. */
+  struct list queue;            /* Pending requests, oldest first. */
+  struct semaphore queue_wait;  /* Up'd to wake an idle dispatcher. */
+  bool dispatcher_idle;         /* Is the dispatcher waiting for work? */
+  uint64_t head;                /* Elevator position (see request_pos). */
+
+  uint16_t bm_base;  /* Bus master I/O port base, 0 if none. */
+  struct prd *prdt;  /* Physical region descriptor table. */
+  bool dma_active;   /* True while a bus master transfer runs. */
+  uint8_t bm_status; /* Bus master status at the last interrupt. */
+
   struct ata_disk devices[2]; /* The devices on this channel. */
 };
 
@@ -85,11 +160,23 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void dispatcher (void *channel_);
+static struct block_request *choose_request (struct channel *);
+static void collect_batch (struct channel *, struct list *batch);
+static void perform_batch (struct list *batch);
+static bool transfer_pio (struct ata_disk *, struct list *batch, bool write);
+static bool transfer_dma (struct ata_disk *, struct list *batch, bool write);
+
+static void select_sectors (struct ata_disk *, block_sector_t, size_t);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
+static uint16_t find_bus_master (void);
+static void prepare_dma (struct channel *, struct list *batch, bool read);
+static void start_dma (struct channel *);
+static bool finish_dma (struct channel *);
+
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
@@ -101,6 +188,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void)
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -123,9 +211,21 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      list_init (&c->queue);
+      sema_init (&c->queue_wait, 0);
+      c->dispatcher_idle = false;
+      c->head = 0;
+
+      /* Set up bus master DMA, if available.  The PRD table must
+         not cross a 64 kB boundary, which a page never does. */
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+      c->prdt = NULL;
+      c->dma_active = false;
+      c->bm_status = 0;
+      if (c->bm_base != 0)
+        c->prdt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +236,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->use_dma = false;
         }
 
       /* Register interrupt handler. */
@@ -144,6 +245,12 @@ ide_init (void)
       /* Reset hardware. */
       reset_channel (c);
 
+      /* Start serving requests.  The dispatcher does not touch
+         the hardware until the first request arrives, which
+         cannot happen until a disk has been identified and
+         registered below. */
+      thread_create (c->name, PRI_DEFAULT, dispatcher, c);
+
       /* Distinguish ATA hard disks from other devices. */
       if (check_device_type (&c->devices[0]))
         check_device_type (&c->devices[1]);
@@ -283,10 +390,13 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *)&id[60 * 2];
+  d->use_dma
+      = c->bm_base != 0 && (*(uint16_t *)&id[49 * 2] & ID_CAP_DMA) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
-  snprintf (extra_info, sizeof extra_info, "model \"%s\", serial \"%s\"",
-            model, serial);
+  snprintf (extra_info, sizeof extra_info,
+            "model \"%s\", serial \"%s\", %s", model, serial,
+            d->use_dma ? "DMA" : "PIO");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -336,59 +446,268 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Queues REQUEST for disk D and returns without waiting for it
+   to complete. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_submit (void *d_, struct block_request *request)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  enum intr_level old_level;
+
+  request->driver = d;
+  request->deadline
+      = timer_ticks () + (request->write ? WRITE_EXPIRE : READ_EXPIRE);
+
+  old_level = intr_disable ();
+  list_push_back (&c->queue, &request->elem);
+  if (c->dispatcher_idle)
+    {
+      c->dispatcher_idle = false;
+      sema_up (&c->queue_wait);
+    }
+  intr_set_level (old_level);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+static struct block_operations ide_operations = { NULL, NULL, ide_submit };
+
+/* Request dispatching. */
+
+/* Returns REQUEST's position for the purpose of elevator
+   ordering.  Requests for the slave device sort after all of
+   those for the master. */
+static uint64_t
+request_pos (const struct block_request *request)
+{
+  const struct ata_disk *d = request->driver;
+  return ((uint64_t)d->dev_no << 32) | request->hw_sector;
+}
+
+/* Dispatcher thread for the channel passed as CHANNEL_.
+   Repeatedly takes a batch of adjacent requests off the queue,
+   carries them out as one transfer, and completes them. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+dispatcher (void *channel_)
+{
+  struct channel *c = channel_;
+  struct list batch;
+
+  list_init (&batch);
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      while (list_empty (&c->queue))
+        {
+          c->dispatcher_idle = true;
+          sema_down (&c->queue_wait);
+        }
+      collect_batch (c, &batch);
+      intr_set_level (old_level);
+
+      perform_batch (&batch);
+    }
+}
+
+/* Picks the next request to dispatch from channel C's queue,
+   which must not be empty.  Interrupts must be off. */
+static struct block_request *
+choose_request (struct channel *c)
+{
+  struct block_request *oldest, *next, *lowest;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!list_empty (&c->queue));
+
+  /* Serve an expired request first, so that a stream of
+     requests near the head cannot starve one far away. */
+  oldest = list_entry (list_front (&c->queue), struct block_request, elem);
+  if (timer_ticks () >= oldest->deadline)
+    return oldest;
+
+  /* Otherwise, take the nearest request at or past the head,
+     wrapping around to the lowest-numbered one (C-LOOK). */
+  next = lowest = NULL;
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      uint64_t pos = request_pos (r);
+
+      if (pos >= c->head && (next == NULL || pos < request_pos (next)))
+        next = r;
+      if (lowest == NULL || pos < request_pos (lowest))
+        lowest = r;
+    }
+  return next != NULL ? next : lowest;
+}
+
+/* Moves the next request from channel C's queue into BATCH,
+   which must be empty, followed by any other queued requests
+   that extend it into a longer contiguous transfer in the same
+   direction on the same disk, in ascending sector order.
+   Interrupts must be off. */
+static void
+collect_batch (struct channel *c, struct list *batch)
+{
+  struct block_request *first = choose_request (c);
+  struct ata_disk *d = first->driver;
+  block_sector_t start = first->hw_sector;
+  block_sector_t end = start + first->sector_cnt;
+  bool merged;
+
+  ASSERT (list_empty (batch));
+
+  list_remove (&first->elem);
+  list_push_back (batch, &first->elem);
+  do
+    {
+      struct list_elem *e;
+
+      merged = false;
+      for (e = list_begin (&c->queue); e != list_end (&c->queue);
+           e = list_next (e))
+        {
+          struct block_request *r
+              = list_entry (e, struct block_request, elem);
+
+          if (r->driver != d || r->write != first->write
+              || end - start + r->sector_cnt > MAX_TRANSFER)
+            continue;
+
+          if (r->hw_sector == end)
+            {
+              list_remove (&r->elem);
+              list_push_back (batch, &r->elem);
+              end += r->sector_cnt;
+              merged = true;
+              break;
+            }
+          else if (r->hw_sector + r->sector_cnt == start)
+            {
+              list_remove (&r->elem);
+              list_push_front (batch, &r->elem);
+              start = r->hw_sector;
+              merged = true;
+              break;
+            }
+        }
+    }
+  while (merged);
+
+  c->head = ((uint64_t)d->dev_no << 32) | end;
+}
+
+/* Carries out the requests in BATCH, which were collected by
+   collect_batch(), as a single transfer, and then completes and
+   removes them from BATCH. */
+static void
+perform_batch (struct list *batch)
+{
+  struct block_request *first
+      = list_entry (list_front (batch), struct block_request, elem);
+  struct ata_disk *d = first->driver;
+  struct list_elem *e;
+  bool ok;
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    block_dispatched (list_entry (e, struct block_request, elem));
+  ok = (d->use_dma ? transfer_dma (d, batch, first->write)
+                   : transfer_pio (d, batch, first->write));
+  if (!ok)
+    PANIC ("%s: disk %s failed, sector=%" PRDSNu, d->name,
+           first->write ? "write" : "read", first->hw_sector);
+
+  while (!list_empty (batch))
+    block_complete (
+        list_entry (list_pop_front (batch), struct block_request, elem));
+}
+
+/* Returns the total number of sectors in the requests in BATCH. */
+static size_t
+batch_sectors (struct list *batch)
+{
+  struct list_elem *e;
+  size_t sector_cnt = 0;
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    sector_cnt += list_entry (e, struct block_request, elem)->sector_cnt;
+  return sector_cnt;
+}
+
+/* Transfers the sectors of the requests in BATCH to or from disk
+   D with programmed I/O, interrupting once per sector.  Returns
+   true if successful, false on a disk error. */
+static bool
+transfer_pio (struct ata_disk *d, struct list *batch, bool write)
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct block_request *first
+      = list_entry (list_front (batch), struct block_request, elem);
+  struct list_elem *e;
+
+  select_sectors (d, first->hw_sector, batch_sectors (batch));
+  issue_pio_command (c, write ? CMD_WRITE_SECTOR_RETRY
+                              : CMD_READ_SECTOR_RETRY);
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      uint8_t *buffer = r->buffer;
+      size_t i;
+
+      for (i = 0; i < r->sector_cnt; i++)
+        {
+          uint8_t *sector = buffer + i * BLOCK_SECTOR_SIZE;
+          if (write)
+            {
+              if (!wait_while_busy (d))
+                return false;
+              output_sector (c, sector);
+              sema_down (&c->completion_wait);
+            }
+          else
+            {
+              sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                return false;
+              input_sector (c, sector);
+            }
+        }
+    }
+  return true;
 }
 
-static struct block_operations ide_operations = { ide_read, ide_write };
+/* Transfers the sectors of the requests in BATCH to or from disk
+   D with a single bus master DMA command.  Returns true if
+   successful, false on a disk error. */
+static bool
+transfer_dma (struct ata_disk *d, struct list *batch, bool write)
+{
+  struct channel *c = d->channel;
+  struct block_request *first
+      = list_entry (list_front (batch), struct block_request, elem);
+
+  select_sectors (d, first->hw_sector, batch_sectors (batch));
+  prepare_dma (c, batch, !write);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  start_dma (c);
+  sema_down (&c->completion_wait);
+  return finish_dma (c);
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and SECTOR_CNT to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t sector_cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (sector_cnt > 0 && sector_cnt <= 256);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), sector_cnt); /* 0 means 256. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -425,6 +744,104 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Bus master DMA. */
+
+/* Looks for a PCI bus master IDE controller that decodes the
+   legacy ATA ports and enables it to master the bus.  Returns
+   the I/O port base of its bus master registers, or 0 if there
+   is no usable controller. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_device dev;
+  uint16_t bm_base;
+
+  /* Class 1 is mass storage, subclass 1 is IDE.  Bits 0 and 2 of
+     the programming interface are set when the primary or
+     secondary channel runs in native PCI mode, in which case it
+     does not live at the legacy ports used by this driver.  Bit
+     7 is set if the controller supports bus mastering. */
+  if (!pci_find_class (0x01, 0x01, 0, &dev) || (dev.prog_if & 0x05) != 0
+      || (dev.prog_if & 0x80) == 0)
+    return 0;
+
+  bm_base = pci_io_base (&dev, 4);
+  if (bm_base == 0)
+    return 0;
+
+  pci_enable (&dev, PCI_CMD_IO | PCI_CMD_MASTER);
+  printf ("ide: bus master DMA at port %#" PRIx16 "\n", bm_base);
+  return bm_base;
+}
+
+/* Fills channel C's PRD table to describe the buffers of the
+   requests in BATCH, in order, and programs the controller for a
+   transfer in the given direction: from the disk into memory if
+   READ is true, from memory to the disk otherwise.  The transfer
+   does not start until start_dma() is called. */
+static void
+prepare_dma (struct channel *c, struct list *batch, bool read)
+{
+  struct list_elem *e;
+  size_t prd_cnt = 0;
+
+  ASSERT (c->bm_base != 0);
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      uintptr_t paddr = vtop (r->buffer);
+      size_t size = r->sector_cnt * BLOCK_SECTOR_SIZE;
+
+      /* Kernel virtual memory maps physical memory linearly, so
+         each buffer is physically contiguous.  Split it only
+         where it crosses a 64 kB boundary. */
+      while (size > 0)
+        {
+          size_t boundary = 0x10000 - (paddr & 0xffff);
+          size_t chunk = size < boundary ? size : boundary;
+          struct prd *prd = &c->prdt[prd_cnt++];
+
+          ASSERT (prd_cnt <= PRD_CNT);
+          prd->addr = paddr;
+          prd->size = chunk & 0xffff;
+          prd->flags = 0;
+
+          paddr += chunk;
+          size -= chunk;
+        }
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  outb (reg_bm_command (c), read ? BM_CMD_READ : 0);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_status (c), BM_STA_ERROR | BM_STA_INTR);
+}
+
+/* Starts the bus master transfer set up by prepare_dma().  The
+   ATA command must already have been issued. */
+static void
+start_dma (struct channel *c)
+{
+  c->dma_active = true;
+  outb (reg_bm_command (c), inb (reg_bm_command (c)) | BM_CMD_START);
+}
+
+/* Stops channel C's bus master after its completion interrupt
+   and returns true if the transfer succeeded. */
+static bool
+finish_dma (struct channel *c)
+{
+  uint8_t status;
+
+  outb (reg_bm_command (c), inb (reg_bm_command (c)) & ~BM_CMD_START);
+  c->dma_active = false;
+
+  status = inb (reg_status (c));
+  return (c->bm_status & BM_STA_ERROR) == 0
+         && (status & (STA_BSY | STA_ERR)) == 0;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -508,6 +925,13 @@ interrupt_handler (struct intr_frame *f)
       {
         if (c->expecting_interrupt)
           {
+            if (c->dma_active)
+              {
+                /* Remember how the transfer went and clear the
+                   bus master's interrupt bit. */
+                c->bm_status = inb (reg_bm_status (c));
+                outb (reg_bm_status (c), BM_STA_INTR);
+              }
             inb (reg_status (c));          /* Acknowledge interrupt. */
             sema_up (&c->completion_wait); /* Wake up waiter. */
           }
@@ -314,5 +314,15 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Carries out REQUEST on partition P by passing it on to P's
+   underlying block device. */
+static void
+partition_submit (void *p_, struct block_request *request)
+{
+  struct partition *p = p_;
+  request->hw_sector += p->start;
+  block_forward (p->block, request);
+}
+
 static struct block_operations partition_operations
-    = { partition_read, partition_write };
+    = { partition_read, partition_write, partition_submit };
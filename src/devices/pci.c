@@ -0,0 +1,193 @@
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include <debug.h>
+
+/* Minimal access to PCI configuration space, through
+   configuration mechanism #1 found on every PC chipset that
+   Pintos runs on.  We only need enough of it to locate a few
+   controllers and read their resource assignments, which the
+   BIOS has already made for us. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8 /* Selects bus/device/function/reg. */
+#define PCI_CONFIG_DATA 0xcfc    /* Data for the selected register. */
+
+/* Bus topology limits. */
+#define PCI_BUS_CNT 256
+#define PCI_SLOT_CNT 32
+#define PCI_FUNC_CNT 8
+
+/* Header type register bit for multifunction devices. */
+#define PCI_HEADER_MULTIFUNCTION 0x80
+
+typedef bool match_func (const struct pci_device *, uint32_t a, uint32_t b);
+
+static bool find (match_func *, uint32_t a, uint32_t b, int idx,
+                  struct pci_device *);
+static uint32_t config_read (uint8_t bus, uint8_t slot, uint8_t func,
+                             uint8_t reg);
+static void config_select (uint8_t bus, uint8_t slot, uint8_t func,
+                           uint8_t reg);
+
+static bool
+match_id (const struct pci_device *dev, uint32_t vendor_id,
+          uint32_t device_id)
+{
+  return dev->vendor_id == vendor_id && dev->device_id == device_id;
+}
+
+static bool
+match_class (const struct pci_device *dev, uint32_t class, uint32_t subclass)
+{
+  return dev->class == class && dev->subclass == subclass;
+}
+
+/* Finds the IDX'th (counting from 0) PCI function with the given
+   VENDOR_ID and DEVICE_ID and stores its description in *DEV.
+   Returns true if successful, false if there is no such
+   function. */
+bool
+pci_find_device (uint16_t vendor_id, uint16_t device_id, int idx,
+                 struct pci_device *dev)
+{
+  return find (match_id, vendor_id, device_id, idx, dev);
+}
+
+/* Finds the IDX'th (counting from 0) PCI function with the given
+   CLASS and SUBCLASS and stores its description in *DEV.
+   Returns true if successful, false if there is no such
+   function. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, int idx,
+                struct pci_device *dev)
+{
+  return find (match_class, class, subclass, idx, dev);
+}
+
+/* Returns the 32-bit configuration register REG of DEV.
+   REG must be a multiple of 4. */
+uint32_t
+pci_read_config (const struct pci_device *dev, uint8_t reg)
+{
+  return config_read (dev->bus, dev->slot, dev->func, reg);
+}
+
+/* Writes VALUE to the 32-bit configuration register REG of DEV.
+   REG must be a multiple of 4. */
+void
+pci_write_config (const struct pci_device *dev, uint8_t reg, uint32_t value)
+{
+  enum intr_level old_level;
+
+  ASSERT (reg % 4 == 0);
+
+  old_level = intr_disable ();
+  config_select (dev->bus, dev->slot, dev->func, reg);
+  outl (PCI_CONFIG_DATA, value);
+  intr_set_level (old_level);
+}
+
+/* Returns the I/O port base programmed into base address
+   register BAR (0...5) of DEV, or 0 if BAR is unassigned or
+   decodes memory space instead of I/O space. */
+uint16_t
+pci_io_base (const struct pci_device *dev, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+
+  value = pci_read_config (dev, PCI_REG_BAR0 + bar * 4);
+  if ((value & 1) == 0)
+    return 0;
+  return value & 0xfffc;
+}
+
+/* Sets the bits in COMMAND (a combination of PCI_CMD_*) in DEV's
+   command register, leaving the others alone. */
+void
+pci_enable (const struct pci_device *dev, uint16_t command)
+{
+  uint32_t value = pci_read_config (dev, PCI_REG_COMMAND);
+
+  /* The upper half is the status register, whose bits are
+     cleared by writing 1s, so be sure to write back 0s there. */
+  pci_write_config (dev, PCI_REG_COMMAND, (value & 0xffff) | command);
+}
+
+/* Scans every bus, device, and function for the IDX'th function
+   for which MATCH returns true given A and B. */
+static bool
+find (match_func *match, uint32_t a, uint32_t b, int idx,
+      struct pci_device *dev)
+{
+  int bus, slot, func;
+
+  for (bus = 0; bus < PCI_BUS_CNT; bus++)
+    for (slot = 0; slot < PCI_SLOT_CNT; slot++)
+      for (func = 0; func < PCI_FUNC_CNT; func++)
+        {
+          uint32_t id = config_read (bus, slot, func, PCI_REG_ID);
+          uint32_t class;
+
+          if ((id & 0xffff) == 0xffff)
+            {
+              /* No function here.  If function 0 is missing,
+                 the whole device is. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          class = config_read (bus, slot, func, PCI_REG_CLASS);
+          dev->bus = bus;
+          dev->slot = slot;
+          dev->func = func;
+          dev->vendor_id = id & 0xffff;
+          dev->device_id = id >> 16;
+          dev->class = class >> 24;
+          dev->subclass = class >> 16;
+          dev->prog_if = class >> 8;
+          dev->irq = config_read (bus, slot, func, PCI_REG_INTERRUPT);
+          if (match (dev, a, b) && idx-- == 0)
+            return true;
+
+          /* Only multifunction devices have functions past 0. */
+          if (func == 0
+              && !((config_read (bus, slot, 0, PCI_REG_HEADER) >> 16)
+                   & PCI_HEADER_MULTIFUNCTION))
+            break;
+        }
+
+  return false;
+}
+
+/* Reads 32-bit configuration register REG of the given BUS,
+   SLOT, and FUNC. */
+static uint32_t
+config_read (uint8_t bus, uint8_t slot, uint8_t func, uint8_t reg)
+{
+  enum intr_level old_level;
+  uint32_t value;
+
+  ASSERT (reg % 4 == 0);
+
+  old_level = intr_disable ();
+  config_select (bus, slot, func, reg);
+  value = inl (PCI_CONFIG_DATA);
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Points the configuration data port at register REG of the
+   given BUS, SLOT, and FUNC.  Interrupts must be off, so that
+   the selection and the data access are atomic. */
+static void
+config_select (uint8_t bus, uint8_t slot, uint8_t func, uint8_t reg)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  outl (PCI_CONFIG_ADDRESS, 0x80000000 | ((uint32_t)bus << 16)
+                                | ((uint32_t)slot << 11)
+                                | ((uint32_t)func << 8) | reg);
+}
@@ -0,0 +1,46 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Standard PCI configuration space registers. */
+#define PCI_REG_ID 0x00        /* Device ID (31:16), vendor ID (15:0). */
+#define PCI_REG_COMMAND 0x04   /* Status (31:16), command (15:0). */
+#define PCI_REG_CLASS 0x08     /* Class, subclass, prog IF, revision. */
+#define PCI_REG_HEADER 0x0c    /* Header type (23:16), among others. */
+#define PCI_REG_BAR0 0x10      /* First base address register. */
+#define PCI_REG_INTERRUPT 0x3c /* Interrupt pin (15:8), line (7:0). */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001     /* Respond to I/O space accesses. */
+#define PCI_CMD_MEMORY 0x0002 /* Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004 /* Allow the device to master the bus. */
+
+/* A function on the PCI bus. */
+struct pci_device
+{
+  uint8_t bus;        /* Bus number. */
+  uint8_t slot;       /* Device number on the bus. */
+  uint8_t func;       /* Function number within the device. */
+  uint16_t vendor_id; /* Vendor, e.g. 0x8086 for Intel. */
+  uint16_t device_id; /* Vendor-specific device identifier. */
+  uint8_t class;      /* Base class, e.g. 0x01 for mass storage. */
+  uint8_t subclass;   /* Subclass, e.g. 0x01 for IDE. */
+  uint8_t prog_if;    /* Programming interface. */
+  uint8_t irq;        /* Interrupt line assigned by the BIOS. */
+};
+
+bool pci_find_device (uint16_t vendor_id, uint16_t device_id, int idx,
+                      struct pci_device *);
+bool pci_find_class (uint8_t class, uint8_t subclass, int idx,
+                     struct pci_device *);
+
+uint32_t pci_read_config (const struct pci_device *, uint8_t reg);
+void pci_write_config (const struct pci_device *, uint8_t reg,
+                       uint32_t value);
+
+uint16_t pci_io_base (const struct pci_device *, int bar);
+void pci_enable (const struct pci_device *, uint16_t command);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,103 @@
+#include "devices/ramdisk.h"
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+
+/* A block device whose sectors are kept in kernel memory.
+
+   It serves requests with a memcpy() and no queueing, so it
+   makes a fast swap device and, for benchmarking, a file system
+   device with no I/O latency at all.  Its contents are lost at
+   shutdown, so it starts out zeroed and without partitions. */
+
+/* Number of sectors stored in each page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+{
+  uint8_t **pages; /* Pages that hold the sectors. */
+  size_t page_cnt; /* Number of pages. */
+};
+
+static struct ramdisk ramdisk;
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk named "ram0" of SIZE_KB kilobytes, rounded
+   up to a whole number of pages, and registers it as a raw
+   block device.  The pages come from the kernel pool.  Prints a
+   message and does nothing if there is not enough memory. */
+void
+ramdisk_init (size_t size_kb)
+{
+  struct ramdisk *rd = &ramdisk;
+  struct block *block;
+  size_t i;
+
+  ASSERT (size_kb > 0);
+
+  rd->page_cnt = DIV_ROUND_UP (size_kb * 1024, PGSIZE);
+  rd->pages = calloc (rd->page_cnt, sizeof *rd->pages);
+  if (rd->pages == NULL)
+    goto no_memory;
+  for (i = 0; i < rd->page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        {
+          while (i-- > 0)
+            palloc_free_page (rd->pages[i]);
+          free (rd->pages);
+          goto no_memory;
+        }
+    }
+
+  block = block_register ("ram0", BLOCK_RAW, "RAM disk",
+                          rd->page_cnt * SECTORS_PER_PAGE,
+                          &ramdisk_operations, rd);
+  partition_scan (block);
+  return;
+
+no_memory:
+  printf ("ram0: not enough memory for %zu kB RAM disk\n", size_kb);
+  rd->page_cnt = 0;
+  rd->pages = NULL;
+}
+
+/* Returns the address of sector SEC_NO within RAM disk RD. */
+static uint8_t *
+sector_address (struct ramdisk *rd, block_sector_t sec_no)
+{
+  size_t page_idx = sec_no / SECTORS_PER_PAGE;
+
+  ASSERT (page_idx < rd->page_cnt);
+  return rd->pages[page_idx] + sec_no % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE;
+}
+
+/* Reads sector SEC_NO from RAM disk RD_ into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *rd_, block_sector_t sec_no, void *buffer)
+{
+  struct ramdisk *rd = rd_;
+  memcpy (buffer, sector_address (rd, sec_no), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SEC_NO to RAM disk RD_ from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_write (void *rd_, block_sector_t sec_no, const void *buffer)
+{
+  struct ramdisk *rd = rd_;
+  memcpy (sector_address (rd, sec_no), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations
+    = { ramdisk_read, ramdisk_write, NULL };
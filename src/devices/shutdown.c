@@ -3,6 +3,9 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include <console.h>
 #include <stdio.h>
@@ -13,6 +16,9 @@
 #include "devices/block.h"
 #include "filesys/filesys.h"
 #endif
+#ifdef VM
+#include "vm/zswap.h"
+#endif
 
 /* Keyboard control register port. */
 #define CONTROL_REG 0x64
@@ -131,8 +137,14 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  kmem_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+#endif
+#ifdef VM
+  zswap_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
@@ -92,6 +92,34 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the number of microseconds since the OS booted.  This
+   is much finer-grained than timer_ticks(), because it also
+   accounts for how far the PIT has counted toward the next
+   tick. */
+int64_t
+timer_usecs (void)
+{
+  static int64_t last_usecs;
+  const int period = (PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ;
+  enum intr_level old_level;
+  int64_t usecs;
+
+  old_level = intr_disable ();
+  usecs = ticks * (1000 * 1000 / TIMER_FREQ)
+          + (period - pit_read_counter (0)) * (int64_t)1000 * 1000 / PIT_HZ;
+
+  /* If the counter wrapped around after interrupts were turned
+     off, the tick it completed has not been counted yet, and the
+     result may be earlier than one we already returned.  Never
+     let time run backward. */
+  if (usecs < last_usecs)
+    usecs = last_usecs;
+  last_usecs = usecs;
+  intr_set_level (old_level);
+
+  return usecs;
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
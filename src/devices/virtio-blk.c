@@ -0,0 +1,414 @@
+#include "devices/virtio-blk.h"
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+
+/* Driver for virtio block devices, as emulated by QEMU with
+   "-drive if=virtio", using the legacy (virtio 0.9.5) PCI
+   interface.  Refer to [Virtio] for details.
+
+   Unlike an IDE disk, a virtio disk accepts many requests at
+   once: each one is a chain of descriptors in a shared ring
+   (the "virtqueue") that the device works through on its own
+   and then hands back, raising an interrupt.  Submitting a
+   request costs a single port write, no matter how many
+   sectors it covers, so we do not queue or sort requests
+   ourselves beyond holding them while the ring is full. */
+
+/* PCI vendor and device IDs of a legacy virtio block device. */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+/* Legacy virtio registers, relative to the I/O port base in
+   BAR0. */
+#define reg_host_features(D) ((D)->io_base + 0x00)  /* 32 bits (r/o). */
+#define reg_guest_features(D) ((D)->io_base + 0x04) /* 32 bits. */
+#define reg_queue_pfn(D) ((D)->io_base + 0x08)      /* 32 bits. */
+#define reg_queue_size(D) ((D)->io_base + 0x0c)     /* 16 bits (r/o). */
+#define reg_queue_select(D) ((D)->io_base + 0x0e)   /* 16 bits. */
+#define reg_queue_notify(D) ((D)->io_base + 0x10)   /* 16 bits. */
+#define reg_status(D) ((D)->io_base + 0x12)         /* 8 bits. */
+#define reg_isr(D) ((D)->io_base + 0x13)      /* 8 bits, clear on read. */
+#define reg_capacity(D) ((D)->io_base + 0x14) /* 64 bits (r/o). */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Guest gave up on the device. */
+
+/* ISR status bits. */
+#define ISR_QUEUE 0x01 /* A virtqueue has been updated. */
+
+/* Descriptor flags. */
+#define VRING_DESC_F_NEXT 0x01  /* Chain continues at NEXT. */
+#define VRING_DESC_F_WRITE 0x02 /* Device writes (vs. reads) buffer. */
+
+/* Used ring flags. */
+#define VRING_USED_F_NO_NOTIFY 0x01 /* Device needs no notification. */
+
+/* Alignment of the used ring within a legacy virtqueue. */
+#define VRING_ALIGN 4096
+
+/* A virtqueue descriptor: one guest-physical buffer. */
+struct vring_desc
+{
+  uint64_t addr;  /* Physical address. */
+  uint32_t len;   /* Length in bytes. */
+  uint16_t flags; /* VRING_DESC_F_*. */
+  uint16_t next;  /* Next descriptor in the chain. */
+};
+
+/* Ring of descriptor chains made available to the device. */
+struct vring_avail
+{
+  uint16_t flags; /* Unused. */
+  uint16_t idx;   /* Where the driver puts the next entry. */
+  uint16_t ring[];
+};
+
+/* An element of the used ring. */
+struct vring_used_elem
+{
+  uint32_t id;  /* Head of the completed descriptor chain. */
+  uint32_t len; /* Number of bytes the device wrote. */
+};
+
+/* Ring of descriptor chains that the device is done with. */
+struct vring_used
+{
+  uint16_t flags; /* VRING_USED_F_*. */
+  uint16_t idx;   /* Where the device puts the next entry. */
+  struct vring_used_elem ring[];
+};
+
+/* Request types. */
+#define VIRTIO_BLK_T_IN 0  /* Read. */
+#define VIRTIO_BLK_T_OUT 1 /* Write. */
+
+/* Request status values. */
+#define VIRTIO_BLK_S_OK 0 /* Success. */
+
+/* Header at the start of each request. */
+struct virtio_blk_outhdr
+{
+  uint32_t type;   /* VIRTIO_BLK_T_*. */
+  uint32_t ioprio; /* Unused. */
+  uint64_t sector; /* First sector. */
+};
+
+/* Each request occupies a fixed "slot" of three chained
+   descriptors: the header, the data buffer, and a status byte
+   that the device fills in. */
+#define DESCS_PER_SLOT 3
+
+/* A request slot. */
+struct slot
+{
+  struct virtio_blk_outhdr hdr;  /* Request header. */
+  uint8_t status;                /* Written by the device. */
+  struct block_request *request; /* Request in progress, if any. */
+};
+
+/* A virtio block device. */
+struct virtio_blk
+{
+  char name[8];     /* Name, e.g. "vda". */
+  uint16_t io_base; /* Base I/O port. */
+  uint8_t irq;      /* Interrupt vector. */
+
+  /* Virtqueue, shared with the device. */
+  uint16_t queue_size;       /* Number of descriptors. */
+  struct vring_desc *desc;   /* Descriptor table. */
+  struct vring_avail *avail; /* Available ring. */
+  struct vring_used *used;   /* Used ring. */
+  uint16_t last_used;        /* Used ring entries consumed so far. */
+
+  /* Request slots and requests waiting for one.  Protected by
+     disabling interrupts, since requests complete in the
+     interrupt handler. */
+  struct slot *slots;  /* QUEUE_SIZE / DESCS_PER_SLOT slots. */
+  int *free_slots;     /* Stack of free slot indexes. */
+  int free_cnt;        /* Number of elements in FREE_SLOTS. */
+  struct list pending; /* Requests waiting for a free slot. */
+};
+
+/* We support a handful of disks, named vda through vdd. */
+#define VIRTIO_BLK_CNT 4
+static struct virtio_blk disks[VIRTIO_BLK_CNT];
+static size_t disk_cnt;
+
+static struct block_operations virtio_blk_operations;
+
+static bool init_device (struct virtio_blk *, struct pci_device *);
+static bool init_queue (struct virtio_blk *);
+static void start_request (struct virtio_blk *, int slot_idx,
+                           struct block_request *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds and initializes virtio block devices, registering each
+   of them with the block layer and scanning it for partitions. */
+void
+virtio_blk_init (void)
+{
+  struct pci_device dev;
+  int idx;
+
+  for (idx = 0; disk_cnt < VIRTIO_BLK_CNT
+                && pci_find_device (VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID,
+                                    idx, &dev);
+       idx++)
+    {
+      struct virtio_blk *d = &disks[disk_cnt];
+      uint64_t capacity;
+      char extra_info[32];
+      struct block *block;
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int)disk_cnt);
+      if (!init_device (d, &dev))
+        continue;
+      disk_cnt++;
+
+      capacity = inl (reg_capacity (d))
+                 | (uint64_t)inl (reg_capacity (d) + 4) << 32;
+      if (capacity > BLOCK_SECTOR_NONE)
+        capacity = BLOCK_SECTOR_NONE;
+      snprintf (extra_info, sizeof extra_info, "virtio, %d slots",
+                d->queue_size / DESCS_PER_SLOT);
+      block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                              &virtio_blk_operations, d);
+      partition_scan (block);
+    }
+}
+
+/* Brings up virtio block device D, which is PCI function DEV.
+   Returns true if successful, false on failure. */
+static bool
+init_device (struct virtio_blk *d, struct pci_device *dev)
+{
+  size_t i;
+
+  d->io_base = pci_io_base (dev, 0);
+  if (d->io_base == 0 || dev->irq >= 16)
+    {
+      printf ("%s: no I/O ports or interrupt assigned\n", d->name);
+      return false;
+    }
+  d->irq = dev->irq + 0x20;
+  pci_enable (dev, PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Reset the device, tell it that we're here, and accept none
+     of the optional features that it offers. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (reg_guest_features (d), 0);
+
+  if (!init_queue (d))
+    {
+      outb (reg_status (d), STATUS_FAILED);
+      return false;
+    }
+
+  /* Several PCI devices may share one interrupt line, so register
+     the handler only once per line and let it poll every disk on
+     the line. */
+  for (i = 0; i < disk_cnt; i++)
+    if (disks[i].irq == d->irq)
+      break;
+  if (i == disk_cnt)
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Sets up D's request virtqueue, number 0, and its request
+   slots.  Returns true if successful, false on failure. */
+static bool
+init_queue (struct virtio_blk *d)
+{
+  size_t avail_size, used_ofs, used_size, page_cnt;
+  int slot_cnt, i;
+  uint8_t *ring;
+
+  outw (reg_queue_select (d), 0);
+  d->queue_size = inw (reg_queue_size (d));
+  slot_cnt = d->queue_size / DESCS_PER_SLOT;
+  if (slot_cnt == 0)
+    {
+      printf ("%s: virtqueue unavailable\n", d->name);
+      return false;
+    }
+
+  /* The legacy layout puts the descriptor table and available
+     ring together, followed by the used ring at the next
+     VRING_ALIGN boundary.  The device takes only the page
+     number of the start. */
+  avail_size = sizeof (uint16_t) * (3 + d->queue_size);
+  used_ofs = ROUND_UP (sizeof *d->desc * d->queue_size + avail_size,
+                       VRING_ALIGN);
+  used_size = sizeof (uint16_t) * 3
+              + sizeof (struct vring_used_elem) * d->queue_size;
+  page_cnt = DIV_ROUND_UP (used_ofs + used_size, PGSIZE);
+  ring = palloc_get_multiple (PAL_ZERO, page_cnt);
+  d->slots = malloc (sizeof *d->slots * slot_cnt);
+  d->free_slots = malloc (sizeof *d->free_slots * slot_cnt);
+  if (ring == NULL || d->slots == NULL || d->free_slots == NULL)
+    {
+      printf ("%s: out of memory for virtqueue\n", d->name);
+      if (ring != NULL)
+        palloc_free_multiple (ring, page_cnt);
+      free (d->slots);
+      free (d->free_slots);
+      return false;
+    }
+  d->desc = (struct vring_desc *)ring;
+  d->avail = (struct vring_avail *)(ring + sizeof *d->desc * d->queue_size);
+  d->used = (struct vring_used *)(ring + used_ofs);
+  d->last_used = 0;
+
+  /* Chain each slot's descriptors together once and for all, and
+     point the header and status descriptors at the slot. */
+  for (i = 0; i < slot_cnt; i++)
+    {
+      struct slot *s = &d->slots[i];
+      struct vring_desc *desc = &d->desc[i * DESCS_PER_SLOT];
+
+      desc[0].addr = vtop (&s->hdr);
+      desc[0].len = sizeof s->hdr;
+      desc[0].flags = VRING_DESC_F_NEXT;
+      desc[0].next = i * DESCS_PER_SLOT + 1;
+
+      desc[1].flags = VRING_DESC_F_NEXT;
+      desc[1].next = i * DESCS_PER_SLOT + 2;
+
+      desc[2].addr = vtop (&s->status);
+      desc[2].len = sizeof s->status;
+      desc[2].flags = VRING_DESC_F_WRITE;
+
+      s->request = NULL;
+      d->free_slots[i] = i;
+    }
+  d->free_cnt = slot_cnt;
+  list_init (&d->pending);
+
+  outl (reg_queue_pfn (d), vtop (ring) / PGSIZE);
+  return true;
+}
+
+/* Starts carrying out REQUEST on disk D_, or queues it until a
+   slot becomes free. */
+static void
+virtio_blk_submit (void *d_, struct block_request *request)
+{
+  struct virtio_blk *d = d_;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (d->free_cnt > 0)
+    start_request (d, d->free_slots[--d->free_cnt], request);
+  else
+    list_push_back (&d->pending, &request->elem);
+  intr_set_level (old_level);
+}
+
+static struct block_operations virtio_blk_operations
+    = { NULL, NULL, virtio_blk_submit };
+
+/* Fills in slot SLOT_IDX of disk D for REQUEST, makes it
+   available to the device, and notifies the device.  Interrupts
+   must be off. */
+static void
+start_request (struct virtio_blk *d, int slot_idx,
+               struct block_request *request)
+{
+  struct slot *s = &d->slots[slot_idx];
+  struct vring_desc *data = &d->desc[slot_idx * DESCS_PER_SLOT + 1];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (s->request == NULL);
+
+  s->request = request;
+  s->hdr.type = request->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  s->hdr.ioprio = 0;
+  s->hdr.sector = request->hw_sector;
+  s->status = 0xff;
+
+  data->addr = vtop (request->buffer);
+  data->len = request->sector_cnt * BLOCK_SECTOR_SIZE;
+  data->flags = VRING_DESC_F_NEXT | (request->write ? 0 : VRING_DESC_F_WRITE);
+
+  /* The device may look at the ring as soon as the index moves,
+     so the entry must be written first. */
+  d->avail->ring[d->avail->idx % d->queue_size] = slot_idx * DESCS_PER_SLOT;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+
+  block_dispatched (request);
+  if (!(d->used->flags & VRING_USED_F_NO_NOTIFY))
+    outw (reg_queue_notify (d), 0);
+}
+
+/* Completes the requests that disk D has finished with, then
+   starts waiting requests in the slots that they free up. */
+static void
+complete_requests (struct virtio_blk *d)
+{
+  while (d->last_used != d->used->idx)
+    {
+      struct vring_used_elem *e;
+      struct block_request *request;
+      struct slot *s;
+      int slot_idx;
+
+      /* Don't read the entry until after its index. */
+      barrier ();
+      e = &d->used->ring[d->last_used % d->queue_size];
+      slot_idx = e->id / DESCS_PER_SLOT;
+      s = &d->slots[slot_idx];
+      request = s->request;
+      if (s->status != VIRTIO_BLK_S_OK)
+        PANIC ("%s: disk %s failed, sector=%" PRDSNu, d->name,
+               request->write ? "write" : "read", request->hw_sector);
+
+      s->request = NULL;
+      d->last_used++;
+      if (!list_empty (&d->pending))
+        start_request (d, slot_idx,
+                       list_entry (list_pop_front (&d->pending),
+                                   struct block_request, elem));
+      else
+        d->free_slots[d->free_cnt++] = slot_idx;
+
+      block_complete (request);
+    }
+}
+
+/* Virtio block interrupt handler.  Checks every disk on the
+   interrupting line. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct virtio_blk *d = &disks[i];
+
+      /* Reading the ISR status also acknowledges the interrupt. */
+      if (d->irq == f->vec_no && (inb (reg_isr (d)) & ISR_QUEUE) != 0)
+        complete_requests (d);
+    }
+}
@@ -164,23 +164,40 @@ cache_write (struct block *block, block_sector_t sector, const void *buffer,
     lock_release (&cb->lock);
 }
 
-/* Writes all dirty cache block back to disk. */
+/* Writes all dirty cache block back to disk.  All of the writes
+   are submitted before waiting for any of them, so that the disk
+   driver can sort and merge them. */
 void
 cache_flush (bool done)
 {
+  /* Too big for a kernel stack.  Protected by cache_lock. */
+  static struct block_request requests[CACHE_SIZE];
+  bool submitted[CACHE_SIZE];
+
   if (done)
     flush_done = done;
   lock_acquire (&cache_lock);
   for (int i = 0; i < CACHE_SIZE; ++i)
     {
       lock_acquire (&cache[i].lock);
-      if (cache[i].valid && cache[i].dirty)
+      submitted[i] = cache[i].valid && cache[i].dirty;
+      if (submitted[i])
         {
-          block_write (cache[i].block, cache[i].sector, cache[i].data);
+          /* Keep the block locked until its write completes. */
+          block_request_init (&requests[i], cache[i].block, cache[i].sector,
+                              1, cache[i].data, true, NULL, NULL);
+          block_submit (&requests[i]);
           cache[i].dirty = false;
         }
-      lock_release (&cache[i].lock);
+      else
+        lock_release (&cache[i].lock);
     }
+  for (int i = 0; i < CACHE_SIZE; ++i)
+    if (submitted[i])
+      {
+        block_wait (&requests[i]);
+        lock_release (&cache[i].lock);
+      }
   lock_release (&cache_lock);
 }
 
@@ -3,6 +3,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include <debug.h>
@@ -48,8 +49,13 @@ struct read_ahead_data
 struct lock read_ahead_lock;
 struct list read_ahead_list;
 struct semaphore read_ahead_sema;
+static struct kmem_cache *read_ahead_cache;
 static void read_ahead_func (void *);
 
+/* Cache of struct indirect_block, for walking indirect
+   blocks. */
+static struct kmem_cache *indirect_cache;
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -94,6 +100,10 @@ inode_init (void)
   lock_init (&read_ahead_lock);
   list_init (&read_ahead_list);
   sema_init (&read_ahead_sema, 0);
+  read_ahead_cache = kmem_cache_create (
+      "read_ahead", sizeof (struct read_ahead_data), NULL);
+  indirect_cache = kmem_cache_create (
+      "indirect_block", sizeof (struct indirect_block), NULL);
   thread_create ("read-ahead", PRI_DEFAULT, read_ahead_func, NULL);
 }
 
@@ -106,13 +116,13 @@ indirect_lookup (const block_sector_t sector, off_t pos)
 {
   if (sector == BLOCK_SECTOR_NONE)
     return BLOCK_SECTOR_NONE;
-  struct indirect_block *ib = malloc (sizeof (struct indirect_block));
+  struct indirect_block *ib = kmem_cache_alloc (indirect_cache);
   cache_read (fs_device, sector, ib, BLOCK_SECTOR_SIZE, 0);
 
   off_t idx = pos / BLOCK_SECTOR_SIZE;
   ASSERT (idx < 128);
   block_sector_t ret = ib->sectors[idx];
-  free (ib);
+  kmem_cache_free (indirect_cache, ib);
   return ret;
 }
 
@@ -122,13 +132,13 @@ doubly_indirect_lookup (const block_sector_t sector, off_t pos)
 {
   if (sector == BLOCK_SECTOR_NONE)
     return BLOCK_SECTOR_NONE;
-  struct indirect_block *ib = malloc (sizeof (struct indirect_block));
+  struct indirect_block *ib = kmem_cache_alloc (indirect_cache);
   cache_read (fs_device, sector, ib, BLOCK_SECTOR_SIZE, 0);
 
   off_t idx = pos / (BLOCK_SECTOR_SIZE * 128);
   off_t pos_ = pos % (BLOCK_SECTOR_SIZE * 128);
   block_sector_t ret = indirect_lookup (ib->sectors[idx], pos_);
-  free (ib);
+  kmem_cache_free (indirect_cache, ib);
   return ret;
 }
 
@@ -166,11 +176,11 @@ inode_indirect_allocate (block_sector_t *sector)
 {
   if (!free_map_allocate (1, sector))
     return false;
-  struct indirect_block *ib = malloc (sizeof (struct indirect_block));
+  struct indirect_block *ib = kmem_cache_alloc (indirect_cache);
   for (int i = 0; i < 128; i++)
     ib->sectors[i] = BLOCK_SECTOR_NONE;
   cache_write (fs_device, *sector, ib, BLOCK_SECTOR_SIZE, 0);
-  free (ib);
+  kmem_cache_free (indirect_cache, ib);
   return true;
 }
 
@@ -207,7 +217,7 @@ inode_grow_unlocked (struct inode_disk *disk_inode, int sectors)
     if (!inode_indirect_allocate (&disk_inode->indirect))
       goto fail;
   {
-    struct indirect_block *ib = malloc (sizeof (struct indirect_block));
+    struct indirect_block *ib = kmem_cache_alloc (indirect_cache);
     cache_read (fs_device, disk_inode->indirect, ib, BLOCK_SECTOR_SIZE, 0);
     for (int i = 0; i < 128 && allocated_sectors < sectors; i++)
       {
@@ -224,12 +234,12 @@ inode_grow_unlocked (struct inode_disk *disk_inode, int sectors)
           {
             cache_write (fs_device, disk_inode->indirect, ib,
                          BLOCK_SECTOR_SIZE, 0);
-            free (ib);
+            kmem_cache_free (indirect_cache, ib);
             goto fail;
           }
       }
     cache_write (fs_device, disk_inode->indirect, ib, BLOCK_SECTOR_SIZE, 0);
-    free (ib);
+    kmem_cache_free (indirect_cache, ib);
   }
 
   if (allocated_sectors >= sectors)
@@ -241,7 +251,7 @@ inode_grow_unlocked (struct inode_disk *disk_inode, int sectors)
     if (!inode_indirect_allocate (doubly_indirect))
       goto fail;
   {
-    struct indirect_block *dib = malloc (sizeof (struct indirect_block));
+    struct indirect_block *dib = kmem_cache_alloc (indirect_cache);
     cache_read (fs_device, *doubly_indirect, dib, BLOCK_SECTOR_SIZE, 0);
     for (int i = 0; i < 128 && allocated_sectors < sectors; i++)
       {
@@ -250,10 +260,10 @@ inode_grow_unlocked (struct inode_disk *disk_inode, int sectors)
           {
             cache_write (fs_device, *doubly_indirect, dib, BLOCK_SECTOR_SIZE,
                          0);
-            free (dib);
+            kmem_cache_free (indirect_cache, dib);
             goto fail;
           }
-        struct indirect_block *ib = malloc (sizeof (struct indirect_block));
+        struct indirect_block *ib = kmem_cache_alloc (indirect_cache);
         cache_read (fs_device, dib->sectors[i], ib, BLOCK_SECTOR_SIZE, 0);
         for (int j = 0; j < 128 && allocated_sectors < sectors; j++)
           {
@@ -272,16 +282,16 @@ inode_grow_unlocked (struct inode_disk *disk_inode, int sectors)
                              0);
                 cache_write (fs_device, *doubly_indirect, dib,
                              BLOCK_SECTOR_SIZE, 0);
-                free (ib);
-                free (dib);
+                kmem_cache_free (indirect_cache, ib);
+                kmem_cache_free (indirect_cache, dib);
                 goto fail;
               }
           }
         cache_write (fs_device, dib->sectors[i], ib, BLOCK_SECTOR_SIZE, 0);
-        free (ib);
+        kmem_cache_free (indirect_cache, ib);
       }
     cache_write (fs_device, *doubly_indirect, dib, BLOCK_SECTOR_SIZE, 0);
-    free (dib);
+    kmem_cache_free (indirect_cache, dib);
   }
 
   if (allocated_sectors >= sectors)
@@ -291,7 +301,7 @@ inode_grow_unlocked (struct inode_disk *disk_inode, int sectors)
 fail:
   if (disk_inode->doubly_indirect != BLOCK_SECTOR_NONE)
     {
-      struct indirect_block *dib = malloc (sizeof (struct indirect_block));
+      struct indirect_block *dib = kmem_cache_alloc (indirect_cache);
       cache_read (fs_device, disk_inode->doubly_indirect, dib,
                   BLOCK_SECTOR_SIZE, 0);
       for (int i = 127; i >= 0 && allocated_sectors > 0; --i)
@@ -299,7 +309,7 @@ fail:
           if (dib->sectors[i] == BLOCK_SECTOR_NONE)
             continue;
 
-          struct indirect_block *ib = malloc (sizeof (struct indirect_block));
+          struct indirect_block *ib = kmem_cache_alloc (indirect_cache);
           cache_read (fs_device, dib->sectors[i], ib, BLOCK_SECTOR_SIZE, 0);
           for (int j = 127; j >= 0 && allocated_sectors > 0; --j)
             if (ib->sectors[j] != BLOCK_SECTOR_NONE)
@@ -333,25 +343,25 @@ fail:
                         cache_write (fs_device, disk_inode->doubly_indirect,
                                      dib, BLOCK_SECTOR_SIZE, 0);
                       }
-                    free (ib);
-                    free (dib);
+                    kmem_cache_free (indirect_cache, ib);
+                    kmem_cache_free (indirect_cache, dib);
                     return false;
                   }
               }
           cache_free (fs_device, dib->sectors[i]);
           free_map_release (dib->sectors[i], 1);
           dib->sectors[i] = BLOCK_SECTOR_NONE;
-          free (ib);
+          kmem_cache_free (indirect_cache, ib);
         }
       cache_free (fs_device, disk_inode->doubly_indirect);
       free_map_release (disk_inode->doubly_indirect, 1);
       disk_inode->doubly_indirect = BLOCK_SECTOR_NONE;
-      free (dib);
+      kmem_cache_free (indirect_cache, dib);
     }
 
   if (disk_inode->indirect != BLOCK_SECTOR_NONE)
     {
-      struct indirect_block *ib = malloc (sizeof (struct indirect_block));
+      struct indirect_block *ib = kmem_cache_alloc (indirect_cache);
       cache_read (fs_device, disk_inode->indirect, ib, BLOCK_SECTOR_SIZE, 0);
       for (int i = 127; i >= 0 && allocated_sectors > 0; --i)
         if (ib->sectors[i] != BLOCK_SECTOR_NONE)
@@ -371,14 +381,14 @@ fail:
                 else
                   cache_write (fs_device, disk_inode->indirect, ib,
                                BLOCK_SECTOR_SIZE, 0);
-                free (ib);
+                kmem_cache_free (indirect_cache, ib);
                 return false;
               }
           }
       cache_free (fs_device, disk_inode->indirect);
       free_map_release (disk_inode->indirect, 1);
       disk_inode->indirect = BLOCK_SECTOR_NONE;
-      free (ib);
+      kmem_cache_free (indirect_cache, ib);
     }
 
   for (int i = 9; i >= 0 && allocated_sectors > 0; --i)
@@ -513,7 +523,7 @@ inode_get_parent (struct inode *inode)
 static void
 inode_indirect_close (block_sector_t sector)
 {
-  struct indirect_block *ib = malloc (sizeof (struct indirect_block));
+  struct indirect_block *ib = kmem_cache_alloc (indirect_cache);
   cache_read (fs_device, sector, ib, BLOCK_SECTOR_SIZE, 0);
 
   for (int i = 0; i < 128; i++)
@@ -525,7 +535,7 @@ inode_indirect_close (block_sector_t sector)
   cache_free (fs_device, sector);
   free_map_release (sector, 1);
 
-  free (ib);
+  kmem_cache_free (indirect_cache, ib);
 }
 
 /* Closes INODE and writes it to disk.
@@ -569,7 +579,7 @@ inode_close (struct inode *inode)
           if (inode->data.doubly_indirect != BLOCK_SECTOR_NONE)
             {
               struct indirect_block *ib
-                  = malloc (sizeof (struct indirect_block));
+                  = kmem_cache_alloc (indirect_cache);
               cache_read (fs_device, inode->data.doubly_indirect, ib,
                           BLOCK_SECTOR_SIZE, 0);
               for (int i = 0; i < 128; i++)
@@ -577,7 +587,7 @@ inode_close (struct inode *inode)
                   inode_indirect_close (ib->sectors[i]);
               cache_free (fs_device, inode->data.doubly_indirect);
               free_map_release (inode->data.doubly_indirect, 1);
-              free (ib);
+              kmem_cache_free (indirect_cache, ib);
             }
 
           cache_free (fs_device, inode->sector);
@@ -644,13 +654,15 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       sector_idx = byte_to_sector_unlocked (inode, offset + BLOCK_SECTOR_SIZE);
       if (sector_idx != BLOCK_SECTOR_NONE)
         {
-          struct read_ahead_data *ra
-              = malloc (sizeof (struct read_ahead_data));
-          ra->sector = sector_idx;
-          lock_acquire (&read_ahead_lock);
-          list_push_back (&read_ahead_list, &ra->elem);
-          lock_release (&read_ahead_lock);
-          sema_up (&read_ahead_sema);
+          struct read_ahead_data *ra = kmem_cache_alloc (read_ahead_cache);
+          if (ra != NULL)
+            {
+              ra->sector = sector_idx;
+              lock_acquire (&read_ahead_lock);
+              list_push_back (&read_ahead_list, &ra->elem);
+              lock_release (&read_ahead_lock);
+              sema_up (&read_ahead_sema);
+            }
         }
 
       /* Advance. */
@@ -831,7 +843,7 @@ read_ahead_func (void *aux UNUSED)
           list_pop_front (&read_ahead_list), struct read_ahead_data, elem);
       lock_release (&read_ahead_lock);
       cache_read (fs_device, ra->sector, NULL, 0, 0);
-      free (ra);
+      kmem_cache_free (read_ahead_cache, ra);
     }
 }
 
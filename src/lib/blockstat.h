@@ -0,0 +1,34 @@
+#ifndef __LIB_BLOCKSTAT_H
+#define __LIB_BLOCKSTAT_H
+
+#include <stdint.h>
+
+/* Number of buckets in a latency histogram.  Bucket 0 counts
+   latencies under 1 microsecond, and bucket I > 0 counts those
+   of at least 2**(I-1) but less than 2**I microseconds.  The
+   last bucket also counts anything longer. */
+#define BLOCKSTAT_BUCKETS 24
+
+/* I/O statistics for a block device, as printed at shutdown and
+   returned by the blockstat system call.
+
+   A request's wait time runs from its submission until the
+   driver starts carrying it out, that is, the time it spends
+   queued behind other requests.  Its service time runs from
+   then until it completes. */
+struct blockstat
+{
+  char name[16]; /* Device name, e.g. "hda1". */
+  int type;      /* Role or other type (enum block_type). */
+
+  uint64_t read_cnt;    /* Number of sectors read. */
+  uint64_t write_cnt;   /* Number of sectors written. */
+  uint64_t request_cnt; /* Number of requests. */
+  uint64_t seq_cnt;     /* Requests starting where the last one ended. */
+  uint32_t max_depth;   /* Most requests ever outstanding at once. */
+
+  uint32_t wait_hist[BLOCKSTAT_BUCKETS];    /* Wait times. */
+  uint32_t service_hist[BLOCKSTAT_BUCKETS]; /* Service times. */
+};
+
+#endif /* lib/blockstat.h */
@@ -0,0 +1,177 @@
+#include "lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* Number of bits in a hash table index. */
+#define HASH_BITS 10
+
+/* Hash table entry for a position that has not been seen. */
+#define NO_POS UINT16_MAX
+
+static uint32_t
+read32 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Returns a hash of the 4 bytes V, as an index into the table. */
+static unsigned
+hash4 (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Appends the continuation bytes of count CNT, which is at least
+   15, to *OP.  Returns false if that would go past END. */
+static bool
+put_count (uint8_t **op, uint8_t *end, size_t cnt)
+{
+  for (cnt -= 15;; cnt -= 255)
+    {
+      if (*op >= end)
+        return false;
+      *(*op)++ = cnt < 255 ? cnt : 255;
+      if (cnt < 255)
+        return true;
+    }
+}
+
+/* Appends a run to *OP: the LIT_CNT literal bytes at LIT, then,
+   unless MATCH_LEN is 0, a match of MATCH_LEN bytes at OFFSET
+   bytes back.  Returns false if that would go past END. */
+static bool
+put_run (uint8_t **op, uint8_t *end, const uint8_t *lit, size_t lit_cnt,
+         size_t offset, size_t match_len)
+{
+  size_t match_cnt = match_len != 0 ? match_len - LZ_MIN_MATCH : 0;
+
+  if (*op >= end)
+    return false;
+  *(*op)++ = ((lit_cnt < 15 ? lit_cnt : 15) << 4)
+             | (match_cnt < 15 ? match_cnt : 15);
+  if (lit_cnt >= 15 && !put_count (op, end, lit_cnt))
+    return false;
+  if ((size_t)(end - *op) < lit_cnt)
+    return false;
+  memcpy (*op, lit, lit_cnt);
+  *op += lit_cnt;
+
+  if (match_len != 0)
+    {
+      if (end - *op < 2)
+        return false;
+      *(*op)++ = offset & 0xff;
+      *(*op)++ = offset >> 8;
+      if (match_cnt >= 15 && !put_count (op, end, match_cnt))
+        return false;
+    }
+  return true;
+}
+
+/* Compresses the SRC_LEN bytes at SRC into DST, which has room
+   for DST_SIZE bytes, using WORK, which must have LZ_WORK_SIZE
+   bytes, as scratch space.  Returns the compressed length, or 0
+   if it would be more than DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst_, size_t dst_size,
+             void *work)
+{
+  const uint8_t *src = src_;
+  uint8_t *op = dst_;
+  uint8_t *end = op + dst_size;
+  uint16_t *table = work;
+  size_t ip = 0;
+  size_t anchor = 0;
+
+  ASSERT (src_len <= LZ_MAX_LEN);
+  memset (table, 0xff, LZ_WORK_SIZE);
+
+  while (ip + LZ_MIN_MATCH <= src_len)
+    {
+      uint32_t v = read32 (src + ip);
+      unsigned h = hash4 (v);
+      size_t ref = table[h];
+      table[h] = ip;
+      if (ref == NO_POS || read32 (src + ref) != v)
+        {
+          ip++;
+          continue;
+        }
+
+      size_t len = LZ_MIN_MATCH;
+      while (ip + len < src_len && src[ref + len] == src[ip + len])
+        len++;
+      if (!put_run (&op, end, src + anchor, ip - anchor, ip - ref, len))
+        return 0;
+      ip += len;
+      anchor = ip;
+    }
+
+  if (!put_run (&op, end, src + anchor, src_len - anchor, 0, 0))
+    return 0;
+  return op - (uint8_t *)dst_;
+}
+
+/* Reads a count that began as 15 in a token from *IP, which must
+   not go past END.  Returns false if the data is corrupt. */
+static bool
+get_count (const uint8_t **ip, const uint8_t *end, size_t *cnt)
+{
+  uint8_t b;
+  do
+    {
+      if (*ip >= end)
+        return false;
+      b = *(*ip)++;
+      *cnt += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, produced by
+   lz_compress(), into the DST_LEN bytes at DST.  Returns true if
+   successful, false if the data is corrupt or does not decompress
+   to exactly DST_LEN bytes. */
+bool
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t dst_len)
+{
+  const uint8_t *ip = src_;
+  const uint8_t *ip_end = ip + src_len;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_len;
+
+  while (ip < ip_end)
+    {
+      uint8_t token = *ip++;
+      size_t lit_cnt = token >> 4;
+      if (lit_cnt == 15 && !get_count (&ip, ip_end, &lit_cnt))
+        return false;
+      if ((size_t)(ip_end - ip) < lit_cnt || (size_t)(op_end - op) < lit_cnt)
+        return false;
+      memcpy (op, ip, lit_cnt);
+      ip += lit_cnt;
+      op += lit_cnt;
+      if (ip == ip_end)
+        break;
+
+      if (ip_end - ip < 2)
+        return false;
+      size_t offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      size_t len = token & 0xf;
+      if (len == 15 && !get_count (&ip, ip_end, &len))
+        return false;
+      len += LZ_MIN_MATCH;
+      if (offset == 0 || offset > (size_t)(op - dst)
+          || (size_t)(op_end - op) < len)
+        return false;
+
+      /* The match may overlap the bytes it produces. */
+      const uint8_t *ref = op - offset;
+      while (len-- > 0)
+        *op++ = *ref++;
+    }
+  return op == op_end;
+}
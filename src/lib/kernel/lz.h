@@ -0,0 +1,32 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* Fast LZ77-class compression of small buffers, such as pages.
+
+   The compressed data is a sequence of runs.  Each begins with a
+   token byte whose high 4 bits give a count of literal bytes and
+   whose low 4 bits give a match length minus LZ_MIN_MATCH.  A
+   count of 15 is continued in following bytes, each added to it,
+   until one is less than 255.  The literal bytes follow, then,
+   except in the last run, a 2-byte little-endian offset back into
+   the output and the continuation of the match length.
+
+   Inputs are limited to LZ_MAX_LEN bytes, so that offsets always
+   fit in 16 bits. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_MAX_LEN 65535 /* Maximum length of input. */
+#define LZ_MIN_MATCH 4   /* Shortest match encoded. */
+
+/* Size of the work area that lz_compress() needs. */
+#define LZ_WORK_SIZE (1024 * sizeof (uint16_t))
+
+size_t lz_compress (const void *src, size_t src_len, void *dst,
+                    size_t dst_size, void *work);
+bool lz_decompress (const void *src, size_t src_len, void *dst,
+                    size_t dst_len);
+
+#endif /* lib/kernel/lz.h */
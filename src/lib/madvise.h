@@ -0,0 +1,12 @@
+#ifndef __LIB_MADVISE_H
+#define __LIB_MADVISE_H
+
+/* Advice for the madvise system call about how a range of a
+   process's memory will be used. */
+#define MADV_NORMAL 0     /* No particular pattern. */
+#define MADV_RANDOM 1     /* Random access: don't map neighbours. */
+#define MADV_SEQUENTIAL 2 /* Sequential access: read ahead, free behind. */
+#define MADV_WILLNEED 3   /* Will be used soon: read it in now. */
+#define MADV_DONTNEED 4   /* Not needed now: drop its pages and swap. */
+
+#endif /* lib/madvise.h */
@@ -28,7 +28,13 @@ enum
   SYS_MKDIR,   /* Create a directory. */
   SYS_READDIR, /* Reads a directory entry. */
   SYS_ISDIR,   /* Tests if a fd represents a directory. */
-  SYS_INUMBER  /* Returns the inode number for a fd. */
+  SYS_INUMBER, /* Returns the inode number for a fd. */
+
+  /* Extensions. */
+  SYS_BLOCKSTAT, /* Reports block device I/O statistics. */
+  SYS_MSYNC,     /* Writes back a memory mapped file. */
+  SYS_MADVISE,   /* Gives advice about the use of memory. */
+  SYS_RSSLIMIT   /* Limits the frames a process may hold. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -2,9 +2,11 @@
 
 int main (int, char *[]);
 void _start (int argc, char *argv[]);
+void _syscall_init (void);
 
 void
 _start (int argc, char *argv[])
 {
+  _syscall_init ();
   exit (main (argc, argv));
 }
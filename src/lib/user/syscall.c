@@ -1,15 +1,61 @@
 #include "../syscall-nr.h"
 #include <syscall.h>
 
+/* True if system calls can be made with SYSENTER, which the
+   kernel sets up whenever the CPU supports it.  Otherwise they
+   trap with "int $0x30".  Set by _syscall_init(). */
+bool _syscall_sysenter;
+
+void _syscall_init (void);
+
+/* Sets _syscall_sysenter according to whether the CPU supports
+   SYSENTER, that is, whether CPUID exists, which is the case if
+   EFLAGS.ID can be changed, and reports it in bit 11 of EDX for
+   leaf 1.  Called by _start() before main(). */
+void
+_syscall_init (void)
+{
+  unsigned before, after, eax, ebx, ecx, edx;
+
+  asm volatile ("pushfl; popl %0; movl %0, %1; xorl $0x200000, %1; "
+                "pushl %1; popfl; pushfl; popl %1; pushl %0; popfl"
+                : "=&r"(before), "=&r"(after)
+                :
+                : "cc");
+  if (((before ^ after) & 0x200000) == 0)
+    return;
+  asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+  _syscall_sysenter = (edx & (1u << 11)) != 0;
+}
+
+/* Makes the system call whose number and arguments are on the
+   stack just above the return address, and returns with its
+   result in EAX.  ECX and EDX are clobbered.
+
+   The return address is popped off first, so that the stack
+   pointer points to the system call number as the kernel
+   expects.  With SYSENTER, the kernel's SYSEXIT returns directly
+   to the caller, using the stack pointer in ECX and the return
+   address in EDX.  With "int $0x30", we jump back ourselves. */
+asm (".globl _syscall_enter\n"
+     "_syscall_enter:\n"
+     "\tpopl %edx\n"
+     "\tcmpb $0, _syscall_sysenter\n"
+     "\tje 1f\n"
+     "\tmovl %esp, %ecx\n"
+     "\tsysenter\n"
+     "1:\tint $0x30\n"
+     "\tjmp *%edx\n");
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                                      \
   ({                                                                          \
     int retval;                                                               \
-    asm volatile ("pushl %[number]; int $0x30; addl $4, %%esp"                \
+    asm volatile ("pushl %[number]; call _syscall_enter; addl $4, %%esp"      \
                   : "=a"(retval)                                              \
                   : [number] "i"(NUMBER)                                      \
-                  : "memory");                                                \
+                  : "ecx", "edx", "memory");                                  \
     retval;                                                                   \
   })
 
@@ -18,10 +64,11 @@
 #define syscall1(NUMBER, ARG0)                                                \
   ({                                                                          \
     int retval;                                                               \
-    asm volatile ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
+    asm volatile ("pushl %[arg0]; pushl %[number]; "                          \
+                  "call _syscall_enter; addl $8, %%esp"                       \
                   : "=a"(retval)                                              \
                   : [number] "i"(NUMBER), [arg0] "g"(ARG0)                    \
-                  : "memory");                                                \
+                  : "ecx", "edx", "memory");                                  \
     retval;                                                                   \
   })
 
@@ -31,10 +78,10 @@
   ({                                                                          \
     int retval;                                                               \
     asm volatile ("pushl %[arg1]; pushl %[arg0]; "                            \
-                  "pushl %[number]; int $0x30; addl $12, %%esp"               \
+                  "pushl %[number]; call _syscall_enter; addl $12, %%esp"     \
                   : "=a"(retval)                                              \
                   : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1)  \
-                  : "memory");                                                \
+                  : "ecx", "edx", "memory");                                  \
     retval;                                                                   \
   })
 
@@ -44,11 +91,11 @@
   ({                                                                          \
     int retval;                                                               \
     asm volatile ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "             \
-                  "pushl %[number]; int $0x30; addl $16, %%esp"               \
+                  "pushl %[number]; call _syscall_enter; addl $16, %%esp"     \
                   : "=a"(retval)                                              \
                   : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1), \
                     [arg2] "r"(ARG2)                                          \
-                  : "memory");                                                \
+                  : "ecx", "edx", "memory");                                  \
     retval;                                                                   \
   })
 
@@ -173,3 +220,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+blockstat (int idx, struct blockstat *stats)
+{
+  return syscall2 (SYS_BLOCKSTAT, idx, stats);
+}
+
+void
+msync (mapid_t mapid)
+{
+  syscall1 (SYS_MSYNC, mapid);
+}
+
+bool
+madvise (void *addr, size_t len, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, len, advice);
+}
+
+bool
+rsslimit (size_t soft, size_t hard)
+{
+  return syscall2 (SYS_RSSLIMIT, soft, hard);
+}
@@ -1,8 +1,11 @@
 #ifndef __LIB_USER_SYSCALL_H
 #define __LIB_USER_SYSCALL_H
 
+#include <blockstat.h>
 #include <debug.h>
+#include <madvise.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +48,10 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool blockstat (int idx, struct blockstat *);
+void msync (mapid_t);
+bool madvise (void *addr, size_t len, int advice);
+bool rsslimit (size_t soft, size_t hard);
+
 #endif /* lib/user/syscall.h */
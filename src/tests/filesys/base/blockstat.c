@@ -0,0 +1,82 @@
+/* Writes a file several times larger than the buffer cache,
+   reads it back, and checks that the blockstat system call
+   reports the reads on the device that carried them out, both in
+   its request count and in its latency histograms. */
+
+#include <blockstat.h>
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE 102400
+#define MAX_DEVICES 16
+
+static char buf[TEST_SIZE];
+static struct blockstat before[MAX_DEVICES], after[MAX_DEVICES];
+
+/* Stores the statistics of each block device in STATS, which
+   has room for MAX_DEVICES of them, and returns the number of
+   devices. */
+static int
+get_stats (struct blockstat stats[MAX_DEVICES])
+{
+  int cnt;
+
+  for (cnt = 0; cnt < MAX_DEVICES && blockstat (cnt, &stats[cnt]); cnt++)
+    continue;
+  return cnt;
+}
+
+/* Returns the number of requests counted in HIST. */
+static uint64_t
+hist_total (const uint32_t hist[BLOCKSTAT_BUCKETS])
+{
+  uint64_t total = 0;
+  int i;
+
+  for (i = 0; i < BLOCKSTAT_BUCKETS; i++)
+    total += hist[i];
+  return total;
+}
+
+void
+test_main (void)
+{
+  const char *file_name = "blargle";
+  struct blockstat *b, *a;
+  int fd, cnt, i, dev;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  cnt = get_stats (before);
+  check_file (file_name, buf, sizeof buf);
+  if (get_stats (after) != cnt)
+    fail ("number of block devices changed");
+
+  /* The file system device is the one that read the most. */
+  dev = -1;
+  for (i = 0; i < cnt; i++)
+    if (after[i].read_cnt > before[i].read_cnt
+        && (dev < 0 || (after[i].read_cnt - before[i].read_cnt
+                        > after[dev].read_cnt - before[dev].read_cnt)))
+      dev = i;
+  if (dev < 0)
+    fail ("no device read any sectors");
+
+  b = &before[dev];
+  a = &after[dev];
+  if (a->request_cnt <= b->request_cnt)
+    fail ("request count of %s did not go up", a->name);
+  if (hist_total (a->wait_hist) <= hist_total (b->wait_hist))
+    fail ("wait time histogram total of %s did not go up", a->name);
+  if (hist_total (a->service_hist) <= hist_total (b->service_hist))
+    fail ("service time histogram total of %s did not go up", a->name);
+  msg ("statistics went up");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blockstat) begin
+(blockstat) create "blargle"
+(blockstat) open "blargle"
+(blockstat) write "blargle"
+(blockstat) close "blargle"
+(blockstat) open "blargle" for verification
+(blockstat) verified contents of "blargle"
+(blockstat) close "blargle"
+(blockstat) statistics went up
+(blockstat) end
+EOF
+pass;
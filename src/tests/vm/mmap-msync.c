@@ -0,0 +1,43 @@
+/* Writes to a file through a mapping and syncs it with msync,
+   then reads the data back using the read system call while the
+   file is still mapped.  Then overwrites part of the mapping,
+   unmaps it, and verifies that only the change is new. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/sample.inc"
+#include <string.h>
+#include <syscall.h>
+
+#define ACTUAL ((void *)0x10000000)
+
+void
+test_main (void)
+{
+  size_t size = strlen (sample);
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  /* Write file via mmap and sync it. */
+  CHECK (create ("sample.txt", size), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  memcpy (ACTUAL, sample, size);
+  msync (map);
+
+  /* Read back via read() with the mapping still in place. */
+  read (handle, buf, size);
+  CHECK (!memcmp (buf, sample, size), "compare read data against written data");
+
+  /* Change the mapping again, then unmap it. */
+  memset (ACTUAL, 'x', 16);
+  munmap (map);
+
+  seek (handle, 0);
+  read (handle, buf, size);
+  CHECK (!memcmp (buf, "xxxxxxxxxxxxxxxx", 16)
+         && !memcmp (buf + 16, sample + 16, size - 16),
+         "compare read data against written data");
+  close (handle);
+}
@@ -0,0 +1,49 @@
+/* Gives each kind of madvise advice and checks that memory keeps
+   the right contents: advice about access patterns and WILLNEED
+   must not change what a mapping reads, and DONTNEED must turn
+   modified anonymous pages back into zeros.  Advice about an
+   empty range succeeds without doing anything. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/sample.inc"
+#include <string.h>
+#include <syscall.h>
+
+#define ACTUAL ((void *)0x10000000)
+#define SIZE (64 * 4096)
+
+static char buf[SIZE] __attribute__ ((aligned (4096)));
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_SEQUENTIAL),
+         "madvise sequential");
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_WILLNEED), "madvise willneed");
+  if (memcmp (ACTUAL, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+  CHECK (madvise (ACTUAL, strlen (sample), MADV_RANDOM), "madvise random");
+  munmap (map);
+  close (handle);
+
+  memset (buf, 0x5a, SIZE);
+  CHECK (madvise (buf, SIZE, MADV_DONTNEED), "madvise dontneed");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu is %d after dontneed", i, buf[i]);
+
+  buf[0] = 0x5a;
+  CHECK (madvise (buf, 0, MADV_DONTNEED), "zero length succeeds");
+  if (buf[0] != 0x5a)
+    fail ("zero-length dontneed discarded a page");
+
+  CHECK (!madvise (buf + 1, SIZE, MADV_NORMAL), "misaligned address fails");
+  CHECK (!madvise (buf, SIZE, 99), "unknown advice fails");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-madvise) begin
+(page-madvise) open "sample.txt"
+(page-madvise) mmap "sample.txt"
+(page-madvise) madvise sequential
+(page-madvise) madvise willneed
+(page-madvise) madvise random
+(page-madvise) madvise dontneed
+(page-madvise) zero length succeeds
+(page-madvise) misaligned address fails
+(page-madvise) unknown advice fails
+(page-madvise) end
+EOF
+pass;
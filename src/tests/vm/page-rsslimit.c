@@ -0,0 +1,32 @@
+/* Limits the process to a few frames, then writes and checks a
+   much larger array, so that the process has to keep replacing
+   its own pages. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include <string.h>
+#include <syscall.h>
+
+#define SIZE (256 * 4096)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  CHECK (!rsslimit (32, 16), "soft limit above hard limit fails");
+  CHECK (rsslimit (16, 32), "limit resident set to 32 pages");
+
+  msg ("write");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i * 7;
+
+  msg ("read");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char)(i * 7))
+      fail ("byte %zu has bad value %d", i, buf[i]);
+
+  CHECK (rsslimit (0, 0), "remove resident set limits");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rsslimit) begin
+(page-rsslimit) soft limit above hard limit fails
+(page-rsslimit) limit resident set to 32 pages
+(page-rsslimit) write
+(page-rsslimit) read
+(page-rsslimit) remove resident set limits
+(page-rsslimit) end
+EOF
+pass;
@@ -0,0 +1,75 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include "threads/flags.h"
+#include <stdint.h>
+
+/* Optional processor features, as reported in EDX by CPUID
+   leaf 1.  See [IA32-v2a] "CPUID". */
+#define CPUID_PSE (1u << 3)  /* 4 MB pages. */
+#define CPUID_SEP (1u << 11) /* SYSENTER and SYSEXIT. */
+#define CPUID_PGE (1u << 13) /* Global pages. */
+
+/* CR4 Register.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x00000010 /* Page Size Extensions. */
+#define CR4_PGE 0x00000080 /* Page Global Enable. */
+
+/* Model-specific registers.  See [IA32-v3b] Appendix B
+   "Model-Specific Registers (MSRs)". */
+#define MSR_SYSENTER_CS 0x174  /* SYSENTER target code segment. */
+#define MSR_SYSENTER_ESP 0x175 /* SYSENTER target stack pointer. */
+#define MSR_SYSENTER_EIP 0x176 /* SYSENTER target instruction. */
+
+/* Returns the processor's CPUID leaf 1 feature flags, or 0 if it
+   does not support the CPUID instruction, which is the case if
+   EFLAGS.ID can't be changed. */
+static inline uint32_t
+cpu_features (void)
+{
+  uint32_t before, after, eax, ebx, ecx, edx;
+
+  asm volatile ("pushfl\n\t"
+                "popl %0\n\t"
+                "movl %0, %1\n\t"
+                "xorl %2, %1\n\t"
+                "pushl %1\n\t"
+                "popfl\n\t"
+                "pushfl\n\t"
+                "popl %1\n\t"
+                "pushl %0\n\t"
+                "popfl"
+                : "=&r"(before), "=&r"(after)
+                : "i"(FLAG_ID)
+                : "cc");
+  if (((before ^ after) & FLAG_ID) == 0)
+    return 0;
+
+  asm volatile ("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1));
+  return edx;
+}
+
+/* Returns the contents of CR4. */
+static inline uint32_t
+cr4_read (void)
+{
+  uint32_t cr4;
+  asm volatile ("movl %%cr4, %0" : "=r"(cr4));
+  return cr4;
+}
+
+/* Stores CR4 into the CR4 register. */
+static inline void
+cr4_write (uint32_t cr4)
+{
+  asm volatile ("movl %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+/* Stores VALUE into model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  /* See [IA32-v2b] "WRMSR". */
+  asm volatile ("wrmsr" : : "c"(msr), "A"(value));
+}
+
+#endif /* threads/cpu.h */
@@ -6,6 +6,7 @@
 #include "devices/shutdown.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -35,10 +36,13 @@
 #include "vm/frame.h"
 #include "vm/page.h"
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -57,6 +61,9 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -ramdisk: Size of the RAM disk to create, in kB, or 0 for none. */
+static size_t ramdisk_size;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -128,6 +135,9 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  if (ramdisk_size > 0)
+    ramdisk_init (ramdisk_size);
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
@@ -139,8 +149,8 @@ main (void)
 #ifdef VM
   /* Initialize virtual memory system. */
   frame_init ();
-  swap_init ();
   page_init ();
+  swap_init ();
 #endif
 
   if (thread_mlfqs)
@@ -172,13 +182,27 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports 4 MB pages, each 4 MB of physical memory
+   that is wholly present and does not contain kernel text, which
+   must stay read-only, is mapped with a single large page
+   instead of a page table.  If it supports global pages, the
+   kernel mappings are marked global, so that the TLB entries for
+   them survive the CR3 reload in every process switch.  They
+   never change once made. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpu_features ();
+  bool large = (features & CPUID_PSE) != 0;
+  uint32_t global = features & CPUID_PGE ? PTE_G : 0;
+
+  if (large || global)
+    cr4_write (cr4_read () | (large ? CR4_PSE : 0) | (global ? CR4_PGE : 0));
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -190,13 +214,21 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (large && pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_kernel_large (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -269,12 +301,20 @@ parse_options (char **argv)
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-fault-around"))
+        fault_around_pages = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value);
 #endif
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_size = atoi (value);
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-mtrace"))
+        malloc_trace = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -392,10 +432,14 @@ usage (void)
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -fault-around=CNT  Map up to CNT cached pages around a fault.\n"
+          "  -zswap=PAGES       Keep up to PAGES pages of compressed swap.\n"
 #endif
+          "  -ramdisk=SIZE      Create RAM disk ram0 of SIZE kB.\n"
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -mtrace            Report unfreed malloc() blocks at shutdown.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
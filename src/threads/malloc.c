@@ -32,7 +32,21 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Each descriptor counts the blocks allocated and freed and the
+   arenas it holds, and malloc_print_stats() prints those counts.
+   If malloc_trace is set, by the "-mtrace" kernel command-line
+   option, then each block is also preceded by a header that
+   records the size requested and the address malloc() was
+   called from, and links it into a list of the blocks in use.
+   malloc_print_stats() then also reports the blocks that are
+   still in use, by call site.  The "backtrace" utility can
+   translate the call sites into function names. */
+
+/* If true, record where each block is allocated.
+   Controlled by kernel command-line option "-mtrace". */
+bool malloc_trace;
 
 /* Descriptor. */
 struct desc
@@ -41,6 +55,11 @@ struct desc
   size_t blocks_per_arena; /* Number of blocks in an arena. */
   struct list free_list;   /* List of free blocks. */
   struct lock lock;        /* Lock. */
+
+  /* Statistics, protected by LOCK. */
+  size_t alloc_cnt; /* Number of blocks allocated. */
+  size_t free_cnt;  /* Number of blocks freed. */
+  size_t arena_cnt; /* Number of arenas held. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -64,6 +83,28 @@ struct block
 static struct desc descs[10]; /* Descriptors. */
 static size_t desc_cnt;       /* Number of descriptors. */
 
+/* Blocks too big for any descriptor. */
+static struct lock big_lock; /* Protects the counts below. */
+static size_t big_alloc_cnt; /* Number of big blocks allocated. */
+static size_t big_free_cnt;  /* Number of big blocks freed. */
+static size_t big_page_cnt;  /* Number of pages in big blocks in use. */
+
+/* Header of a block, if malloc_trace is set. */
+struct trace
+{
+  struct list_elem elem; /* Element in trace_list. */
+  void *caller;          /* Address malloc() was called from. */
+  size_t size;           /* Size requested. */
+};
+
+/* Blocks in use, if malloc_trace is set. */
+static struct list trace_list;
+static struct lock trace_lock;
+
+static void *traced_malloc (size_t, void *caller);
+static void *alloc_block (size_t);
+static void free_block (void *);
+static void print_leaks (void);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -82,12 +123,49 @@ malloc_init (void)
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+  lock_init (&big_lock);
+  list_init (&trace_list);
+  lock_init (&trace_lock);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size)
+{
+  return traced_malloc (size, __builtin_return_address (0));
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, on
+   behalf of a caller at CALLER, adding a header that records
+   them if malloc_trace is set.  Returns a null pointer if memory
+   is not available. */
+static void *
+traced_malloc (size_t size, void *caller)
+{
+  struct trace *t;
+
+  if (!malloc_trace || size == 0)
+    return alloc_block (size);
+
+  if (size + sizeof *t < size)
+    return NULL;
+  t = alloc_block (size + sizeof *t);
+  if (t == NULL)
+    return NULL;
+  t->caller = caller;
+  t->size = size;
+  lock_acquire (&trace_lock);
+  list_push_back (&trace_list, &t->elem);
+  lock_release (&trace_lock);
+  return t + 1;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes, with
+   no trace header.  Returns a null pointer if memory is not
+   available. */
+static void *
+alloc_block (size_t size)
 {
   struct desc *d;
   struct block *b;
@@ -116,6 +194,11 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+
+      lock_acquire (&big_lock);
+      big_alloc_cnt++;
+      big_page_cnt += page_cnt;
+      lock_release (&big_lock);
       return a + 1;
     }
 
@@ -143,12 +226,14 @@ malloc (size_t size)
           struct block *b = arena_to_block (a, i);
           list_push_back (&d->free_list, &b->free_elem);
         }
+      d->arena_cnt++;
     }
 
   /* Get a block from free list and return it. */
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+  d->alloc_cnt++;
   lock_release (&d->lock);
   return b;
 }
@@ -167,7 +252,7 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = traced_malloc (size, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -178,6 +263,9 @@ calloc (size_t a, size_t b)
 static size_t
 block_size (void *block)
 {
+  if (malloc_trace)
+    return ((struct trace *)block - 1)->size;
+
   struct block *b = block;
   struct arena *a = block_to_arena (b);
   struct desc *d = a->desc;
@@ -201,7 +289,8 @@ realloc (void *old_block, size_t new_size)
     }
   else
     {
-      void *new_block = malloc (new_size);
+      void *new_block
+          = traced_malloc (new_size, __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -217,6 +306,21 @@ realloc (void *old_block, size_t new_size)
    malloc(), calloc(), or realloc(). */
 void
 free (void *p)
+{
+  if (p != NULL && malloc_trace)
+    {
+      struct trace *t = (struct trace *)p - 1;
+      lock_acquire (&trace_lock);
+      list_remove (&t->elem);
+      lock_release (&trace_lock);
+      p = t;
+    }
+  free_block (p);
+}
+
+/* Frees block P, which has no trace header. */
+static void
+free_block (void *p)
 {
   if (p != NULL)
     {
@@ -237,6 +341,7 @@ free (void *p)
 
           /* Add block to free list. */
           list_push_front (&d->free_list, &b->free_elem);
+          d->free_cnt++;
 
           /* If the arena is now entirely unused, free it. */
           if (++a->free_cnt >= d->blocks_per_arena)
@@ -250,6 +355,7 @@ free (void *p)
                   list_remove (&b->free_elem);
                 }
               palloc_free_page (a);
+              d->arena_cnt--;
             }
 
           lock_release (&d->lock);
@@ -257,12 +363,90 @@ free (void *p)
       else
         {
           /* It's a big block.  Free its pages. */
+          lock_acquire (&big_lock);
+          big_free_cnt++;
+          big_page_cnt -= a->free_cnt;
+          lock_release (&big_lock);
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
 
+/* Prints the number of blocks allocated and freed in each size
+   class, and, if malloc_trace is set, the blocks still in use. */
+void
+malloc_print_stats (void)
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->alloc_cnt > 0)
+      printf ("Malloc: %zu-byte blocks: %zu allocated, %zu freed, "
+              "%zu in use, %zu arenas\n",
+              d->block_size, d->alloc_cnt, d->free_cnt,
+              d->alloc_cnt - d->free_cnt, d->arena_cnt);
+  if (big_alloc_cnt > 0)
+    printf ("Malloc: big blocks: %zu allocated, %zu freed, "
+            "%zu in use, %zu pages\n",
+            big_alloc_cnt, big_free_cnt, big_alloc_cnt - big_free_cnt,
+            big_page_cnt);
+  if (malloc_trace)
+    print_leaks ();
+}
+
+/* Prints the blocks still in use, totaled by call site. */
+static void
+print_leaks (void)
+{
+  enum
+  {
+    SITE_CNT = 32
+  };
+  struct site
+  {
+    void *caller;     /* Call site. */
+    size_t block_cnt; /* Number of blocks from CALLER in use. */
+    size_t byte_cnt;  /* Bytes requested in those blocks. */
+  } sites[SITE_CNT];
+  size_t site_cnt = 0;
+  size_t other_cnt = 0;
+  struct list_elem *e;
+
+  lock_acquire (&trace_lock);
+  for (e = list_begin (&trace_list); e != list_end (&trace_list);
+       e = list_next (e))
+    {
+      struct trace *t = list_entry (e, struct trace, elem);
+      size_t i;
+
+      for (i = 0; i < site_cnt; i++)
+        if (sites[i].caller == t->caller)
+          break;
+      if (i == site_cnt)
+        {
+          if (site_cnt == SITE_CNT)
+            {
+              other_cnt++;
+              continue;
+            }
+          sites[i].caller = t->caller;
+          sites[i].block_cnt = sites[i].byte_cnt = 0;
+          site_cnt++;
+        }
+      sites[i].block_cnt++;
+      sites[i].byte_cnt += t->size;
+    }
+  lock_release (&trace_lock);
+
+  for (size_t i = 0; i < site_cnt; i++)
+    printf ("Malloc: %zu bytes in %zu blocks from %p not freed\n",
+            sites[i].byte_cnt, sites[i].block_cnt, sites[i].caller);
+  if (other_cnt > 0)
+    printf ("Malloc: %zu more blocks from other call sites not freed\n",
+            other_cnt);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
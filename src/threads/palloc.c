@@ -1,10 +1,11 @@
 #include "threads/palloc.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -23,14 +24,60 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a buddy allocator.  Its free pages are kept as
+   blocks of 2**K pages, aligned on a multiple of 2**K pages
+   within the pool, on one free list per order K.  A request for
+   N pages splits the smallest free block of at least N pages and
+   returns the pages it doesn't need, and freeing a block merges
+   it with its "buddy", the other half of the block of the next
+   order up, whenever the buddy is free too.  Both take time
+   logarithmic in the size of the pool, so the pools are
+   protected by disabling interrupts, which also lets pages be
+   freed with interrupts off.  A bitmap of the pages in use is
+   kept alongside for assertions and for the idle thread's
+   benefit.
+
+   The idle thread zeroes free pages ahead of time, calling
+   palloc_zero_idle(), and a PAL_ZERO request for a single page is
+   served from those if it can be, so that it need not be zeroed
+   when it is allocated.  Each pool keeps up to an eighth of its
+   pages zeroed. */
+
+/* Number of block orders.  Blocks of order ORDER_CNT - 1 are
+   1 GB, as large as a pool can be. */
+#define ORDER_CNT 19
+
+/* Per-page information. */
+struct buddy_page
+{
+  struct list_elem elem;  /* Element in a free list, if FREE_HEAD. */
+  struct list_elem zelem; /* Element in zeroed_list, if ZEROED. */
+  uint8_t order;          /* Order of the block, if FREE_HEAD. */
+  bool free_head;         /* First page of a free block? */
+  bool zeroed;            /* Free and known to be zeroed? */
+};
 
 /* A memory pool. */
 struct pool
 {
-  struct lock lock;        /* Mutual exclusion. */
-  struct bitmap *used_map; /* Bitmap of free pages. */
-  uint8_t *base;           /* Base of pool. */
+  struct bitmap *used_map;   /* Bitmap of free pages. */
+  struct buddy_page *pages;  /* One per page. */
+  uint8_t *base;             /* Base of pool. */
+  size_t page_cnt;           /* Number of pages. */
+  size_t free_cnt;           /* Number of free pages. */
+  size_t peak_used;          /* Most pages ever in use at once. */
+
+  /* Free blocks. */
+  struct list free_lists[ORDER_CNT]; /* Free blocks of each order. */
+  size_t block_cnt[ORDER_CNT];       /* Number of blocks in each. */
+
+  /* Pages zeroed ahead of time. */
+  struct list zeroed_list;   /* Free pages known to be zeroed. */
+  size_t zeroed_cnt;         /* Number of pages in ZEROED_LIST. */
+  size_t zeroed_max;         /* Number of pages to keep zeroed. */
+  size_t zero_hint;          /* Where to look for one to zero next. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +86,13 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_block (struct pool *, unsigned order);
+static bool take_page (struct pool *, size_t page_idx);
+static void free_range (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t unzero_range (struct pool *, size_t page_idx,
+                            size_t page_cnt);
+static bool zero_free_page (struct pool *);
+static void print_pool_stats (const struct pool *, const char *name);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -73,13 +127,41 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  enum intr_level old_level;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  old_level = intr_disable ();
+  if ((flags & PAL_ZERO) && page_cnt == 1 && pool->zeroed_cnt > 0)
+    {
+      struct buddy_page *p = list_entry (list_front (&pool->zeroed_list),
+                                         struct buddy_page, zelem);
+      page_idx = p - pool->pages;
+      if (!take_page (pool, page_idx))
+        NOT_REACHED ();
+    }
+  else
+    {
+      unsigned order = 0;
+      while (order < ORDER_CNT && ((size_t)1 << order) < page_cnt)
+        order++;
+      page_idx = order < ORDER_CNT ? alloc_block (pool, order) : BITMAP_ERROR;
+      if (page_idx != BITMAP_ERROR)
+        free_range (pool, page_idx + page_cnt,
+                    ((size_t)1 << order) - page_cnt);
+    }
+  size_t zeroed = 0;
+  if (page_idx != BITMAP_ERROR)
+    {
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+      zeroed = unzero_range (pool, page_idx, page_cnt);
+      pool->free_cnt -= page_cnt;
+      if (pool->page_cnt - pool->free_cnt > pool->peak_used)
+        pool->peak_used = pool->page_cnt - pool->free_cnt;
+    }
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -88,7 +170,7 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
   if (pages != NULL)
     {
-      if (flags & PAL_ZERO)
+      if ((flags & PAL_ZERO) && zeroed < page_cnt)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else
@@ -119,6 +201,7 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
   size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -137,8 +220,12 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_range (pool, page_idx, page_cnt);
+  pool->free_cnt += page_cnt;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,15 +235,278 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the address of the first page in the user pool.  Every
+   page obtained with PAL_USER lies within the
+   palloc_user_page_cnt() pages starting there, so tables with an
+   entry per user page can be indexed by page number. */
+void *
+palloc_user_base (void)
+{
+  return user_pool.base;
+}
+
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void)
+{
+  return user_pool.page_cnt;
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t
+palloc_user_free_cnt (void)
+{
+  return user_pool.free_cnt;
+}
+
+/* Zeroes a free page, if one of the pools needs more zeroed
+   pages.  Returns true if a page was zeroed.  Called by the idle
+   thread, so it never sleeps. */
+bool
+palloc_zero_idle (void)
+{
+  return zero_free_page (&user_pool) || zero_free_page (&kernel_pool);
+}
+
+/* Prints the number of pages in use and of free blocks of each
+   order in each pool. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool, "Kernel pool");
+  print_pool_stats (&user_pool, "User pool");
+}
+
+/* Prints POOL's page usage and free blocks of each order,
+   calling it NAME. */
+static void
+print_pool_stats (const struct pool *pool, const char *name)
+{
+  printf ("%s: %zu of %zu pages in use (peak %zu), %zu free pages zeroed\n",
+          name, pool->page_cnt - pool->free_cnt, pool->page_cnt,
+          pool->peak_used, pool->zeroed_cnt);
+  printf ("%s: free blocks by order:", name);
+  for (unsigned order = 0; order < ORDER_CNT; order++)
+    if (pool->block_cnt[order] > 0)
+      printf (" %u:%zu", order, pool->block_cnt[order]);
+  printf ("\n");
+}
+
+/* Zeroes a free page of POOL that isn't zeroed yet and returns
+   true, if POOL has fewer than its quota of zeroed pages.
+   Otherwise, returns false.
+
+   The page is taken out of the pool while it is being zeroed, so
+   that interrupts need only be off while looking it up. */
+static bool
+zero_free_page (struct pool *pool)
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+
+  if (pool->zeroed_cnt >= pool->zeroed_max
+      || pool->free_cnt <= pool->zeroed_cnt)
+    return false;
+
+  /* Look for a candidate without disabling interrupts.  It could
+     be allocated before we take it, so check again after. */
+  for (size_t i = 0; i < pool->page_cnt; i++)
+    {
+      size_t idx = (pool->zero_hint + pool->page_cnt - i) % pool->page_cnt;
+      if (!bitmap_test (pool->used_map, idx) && !pool->pages[idx].zeroed)
+        {
+          page_idx = idx;
+          break;
+        }
+    }
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  old_level = intr_disable ();
+  bool taken = (!bitmap_test (pool->used_map, page_idx)
+                && !pool->pages[page_idx].zeroed
+                && take_page (pool, page_idx));
+  if (taken)
+    bitmap_mark (pool->used_map, page_idx);
+  intr_set_level (old_level);
+  if (!taken)
+    return true;
+
+  memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  bitmap_reset (pool->used_map, page_idx);
+  free_range (pool, page_idx, 1);
+  pool->pages[page_idx].zeroed = true;
+  list_push_front (&pool->zeroed_list, &pool->pages[page_idx].zelem);
+  pool->zeroed_cnt++;
+  intr_set_level (old_level);
+
+  pool->zero_hint = page_idx;
+  return true;
+}
+
+/* Adds the block of 2**ORDER pages at PAGE_IDX to POOL's free
+   lists, without merging it with its buddy. */
+static void
+push_block (struct pool *pool, size_t page_idx, unsigned order)
+{
+  struct buddy_page *p = &pool->pages[page_idx];
+  p->free_head = true;
+  p->order = order;
+  list_push_front (&pool->free_lists[order], &p->elem);
+  pool->block_cnt[order]++;
+}
+
+/* Removes the free block at PAGE_IDX from POOL's free lists. */
+static void
+pop_block (struct pool *pool, size_t page_idx)
+{
+  struct buddy_page *p = &pool->pages[page_idx];
+  ASSERT (p->free_head);
+  list_remove (&p->elem);
+  p->free_head = false;
+  pool->block_cnt[p->order]--;
+}
+
+/* Removes a block of 2**ORDER pages from POOL's free lists,
+   splitting a larger block if there's none that size, and
+   returns the index of its first page.  Returns BITMAP_ERROR if
+   there's no block that large.  Must be called with interrupts
+   off. */
+static size_t
+alloc_block (struct pool *pool, unsigned order)
+{
+  unsigned k;
+  size_t page_idx;
+
+  for (k = order; k < ORDER_CNT; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      break;
+  if (k >= ORDER_CNT)
+    return BITMAP_ERROR;
+
+  page_idx = list_entry (list_front (&pool->free_lists[k]),
+                         struct buddy_page, elem) - pool->pages;
+  pop_block (pool, page_idx);
+  while (k > order)
+    {
+      k--;
+      push_block (pool, page_idx + ((size_t)1 << k), k);
+    }
+  return page_idx;
+}
+
+/* Removes the single free page PAGE_IDX from POOL's free lists,
+   splitting the block that contains it and returning the rest
+   of it.  Returns false if PAGE_IDX isn't in a free block.  Must
+   be called with interrupts off. */
+static bool
+take_page (struct pool *pool, size_t page_idx)
+{
+  for (unsigned k = 0; k < ORDER_CNT; k++)
+    {
+      size_t head = page_idx & ~(((size_t)1 << k) - 1);
+      struct buddy_page *p = &pool->pages[head];
+      if (!p->free_head || p->order != k)
+        continue;
+
+      /* Split the block in halves, keeping the one with PAGE_IDX,
+         until only PAGE_IDX is left. */
+      pop_block (pool, head);
+      while (k > 0)
+        {
+          size_t half;
+
+          k--;
+          half = (size_t)1 << k;
+          if (page_idx < head + half)
+            push_block (pool, head + half, k);
+          else
+            {
+              push_block (pool, head, k);
+              head += half;
+            }
+        }
+      return true;
+    }
+  return false;
+}
+
+/* Returns the block of 2**ORDER pages at PAGE_IDX to POOL,
+   merging it with its buddy as long as the buddy is free. */
+static void
+free_block (struct pool *pool, size_t page_idx, unsigned order)
+{
+  while (order + 1 < ORDER_CNT)
+    {
+      size_t buddy = page_idx ^ ((size_t)1 << order);
+      if (buddy + ((size_t)1 << order) > pool->page_cnt
+          || !pool->pages[buddy].free_head
+          || pool->pages[buddy].order != order)
+        break;
+      pop_block (pool, buddy);
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL's free
+   lists, as the largest aligned blocks that cover them.  Must be
+   called with interrupts off. */
+static void
+free_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      unsigned order = 0;
+      while (order + 1 < ORDER_CNT
+             && page_idx % ((size_t)2 << order) == 0
+             && ((size_t)2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t)1 << order;
+      page_cnt -= (size_t)1 << order;
+    }
+}
+
+/* Forgets that any of the PAGE_CNT pages starting at PAGE_IDX in
+   POOL are zeroed, because they are being allocated, and returns
+   the number that were.  Must be called with interrupts off. */
+static size_t
+unzero_range (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t zeroed = 0;
+
+  if (pool->zeroed_cnt == 0)
+    return 0;
+  for (size_t i = page_idx; i < page_idx + page_cnt; i++)
+    {
+      struct buddy_page *p = &pool->pages[i];
+      if (p->zeroed)
+        {
+          list_remove (&p->zelem);
+          p->zeroed = false;
+          zeroed++;
+        }
+    }
+  pool->zeroed_cnt -= zeroed;
+  return zeroed;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's per-page information and used_map at
+     its base.  Calculate the space needed for them and subtract
+     it from the pool's size. */
+  size_t info_size = page_cnt * sizeof *p->pages;
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (info_size + bm_size, PGSIZE);
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +514,29 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->pages = base;
+  p->used_map = bitmap_create_in_buf (page_cnt, (uint8_t *)base + info_size,
+                                      bm_size);
   p->base = base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  p->free_cnt = page_cnt;
+  p->peak_used = 0;
+  for (unsigned order = 0; order < ORDER_CNT; order++)
+    {
+      list_init (&p->free_lists[order]);
+      p->block_cnt[order] = 0;
+    }
+  list_init (&p->zeroed_list);
+  p->zeroed_cnt = 0;
+  p->zeroed_max = page_cnt / 8;
+  p->zero_hint = page_cnt - 1;
+
+  for (size_t i = 0; i < page_cnt; i++)
+    {
+      p->pages[i].free_head = false;
+      p->pages[i].zeroed = false;
+    }
+  free_range (p, 0, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +546,7 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -16,5 +17,10 @@ void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void *palloc_user_base (void);
+size_t palloc_user_page_cnt (void);
+size_t palloc_user_free_cnt (void);
+bool palloc_zero_idle (void);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
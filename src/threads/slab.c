@@ -0,0 +1,279 @@
+#include "threads/slab.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Object caches ("slab allocator").
+
+   malloc() rounds each request up to a power of 2 and serves all
+   requests of that size from a single descriptor.  A kernel
+   object that is allocated and freed often, such as a
+   supplemental page table entry, can instead be given a cache of
+   its own with kmem_cache_create().  The cache carves pages
+   ("slabs") into objects of exactly that size, rounded up only
+   to a multiple of the pointer size, so there is less waste, and
+   objects of one type are packed together.  The first object in
+   each slab starts on a cache line boundary.
+
+   Each slab keeps its own list of free objects.  A cache keeps
+   the slabs with some free objects on a list, so allocation
+   takes the first free object of the first such slab.  A slab
+   whose objects are all free is given back to the page
+   allocator, except that each cache holds on to one of them, so
+   that a cache whose use goes up and down by a few objects does
+   not keep getting and freeing pages.
+
+   If the cache has a constructor, it is called on each object
+   when its slab is created, and a freed object must be left in
+   its constructed state, so that the constructor need not run
+   again when it is reused.  The free list link of such an object
+   is stored past its end, instead of over its first bytes.
+
+   kmem_print_stats() prints how many objects each cache has
+   handed out and how many pages it holds. */
+
+/* Size of a cache line. */
+#define CACHE_LINE 64
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Object cache. */
+struct kmem_cache
+{
+  const char *name;       /* Name, for debugging. */
+  size_t obj_size;        /* Size of each object in bytes. */
+  size_t slot_size;       /* Space per object, including link. */
+  size_t link_ofs;        /* Offset of free link within slot. */
+  size_t objs_per_slab;   /* Number of objects in a slab. */
+  kmem_ctor_func *ctor;   /* Constructor, or null. */
+  struct list partial;    /* Slabs with free objects. */
+  struct slab *empty;     /* A slab with no objects in use, or null. */
+  struct lock lock;       /* Lock. */
+  struct kmem_cache *next; /* Next in list of all caches. */
+
+  /* Statistics, protected by LOCK. */
+  size_t alloc_cnt;       /* Number of objects allocated. */
+  size_t free_cnt;        /* Number of objects freed. */
+  size_t slab_cnt;        /* Number of slabs held. */
+};
+
+/* All caches, most recently created first. */
+static struct kmem_cache *all_caches;
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+{
+  unsigned magic;           /* Always set to SLAB_MAGIC. */
+  struct kmem_cache *cache; /* Owning cache. */
+  struct list_elem elem;    /* Element in cache's PARTIAL list. */
+  void *free;               /* First free object, or null. */
+  size_t free_cnt;          /* Number of free objects. */
+};
+
+/* Offset of the first object in a slab. */
+#define SLAB_OBJ_OFS ROUND_UP (sizeof (struct slab), CACHE_LINE)
+
+static struct slab *new_slab (struct kmem_cache *);
+static void free_locked (struct kmem_cache *, void *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+
+/* Returns the location of OBJ's free list link in cache C. */
+static inline void **
+obj_link (const struct kmem_cache *c, void *obj)
+{
+  return (void **)((uint8_t *)obj + c->link_ofs);
+}
+
+/* Creates and returns a cache, called NAME, of SIZE-byte
+   objects.  If CTOR is nonnull, it is called to construct each
+   object when its slab is created, and objects must be freed in
+   their constructed state.  Panics if memory is not
+   available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor)
+{
+  struct kmem_cache *c = malloc (sizeof *c);
+  if (c == NULL)
+    PANIC ("kmem_cache_create: out of memory for %s cache", name);
+
+  c->name = name;
+  c->obj_size = size;
+  c->ctor = ctor;
+  if (ctor != NULL)
+    {
+      c->link_ofs = ROUND_UP (size, sizeof (void *));
+      c->slot_size = c->link_ofs + sizeof (void *);
+    }
+  else
+    {
+      c->link_ofs = 0;
+      c->slot_size = ROUND_UP (size > 0 ? size : 1, sizeof (void *));
+    }
+  ASSERT (SLAB_OBJ_OFS + c->slot_size <= PGSIZE);
+  c->objs_per_slab = (PGSIZE - SLAB_OBJ_OFS) / c->slot_size;
+  list_init (&c->partial);
+  c->empty = NULL;
+  lock_init (&c->lock);
+  c->alloc_cnt = c->free_cnt = c->slab_cnt = 0;
+
+  enum intr_level old_level = intr_disable ();
+  c->next = all_caches;
+  all_caches = c;
+  intr_set_level (old_level);
+  return c;
+}
+
+/* Obtains and returns an object from cache C.  Returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else
+    {
+      s = c->empty != NULL ? c->empty : new_slab (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      if (s != c->empty)
+        c->slab_cnt++;
+      c->empty = NULL;
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  obj = s->free;
+  s->free = *obj_link (c, obj);
+  if (--s->free_cnt == 0)
+    list_remove (&s->elem);
+  c->alloc_cnt++;
+  lock_release (&c->lock);
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from cache C, to
+   C.  OBJ may be null. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  kmem_cache_free_many (c, &obj, 1);
+}
+
+/* Returns the CNT objects in OBJS, which must have been obtained
+   from cache C, to C, taking C's lock only once.  Null pointers
+   in OBJS are skipped. */
+void
+kmem_cache_free_many (struct kmem_cache *c, void **objs, size_t cnt)
+{
+#ifndef NDEBUG
+  /* Clear the objects to help detect use-after-free bugs. */
+  if (c->ctor == NULL)
+    for (size_t i = 0; i < cnt; i++)
+      if (objs[i] != NULL)
+        memset (objs[i], 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+  for (size_t i = 0; i < cnt; i++)
+    if (objs[i] != NULL)
+      free_locked (c, objs[i]);
+  lock_release (&c->lock);
+}
+
+/* Returns OBJ to cache C, whose lock must be held. */
+static void
+free_locked (struct kmem_cache *c, void *obj)
+{
+  struct slab *s = obj_to_slab (c, obj);
+  struct slab *old_empty = NULL;
+
+  *obj_link (c, obj) = s->free;
+  s->free = obj;
+  c->free_cnt++;
+  if (s->free_cnt++ == 0)
+    list_push_front (&c->partial, &s->elem);
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      /* Hold on to this slab, giving back the one we had. */
+      list_remove (&s->elem);
+      old_empty = c->empty;
+      c->empty = s;
+      if (old_empty != NULL)
+        c->slab_cnt--;
+    }
+
+  /* The page allocator doesn't sleep, so this is safe to do
+     while holding C's lock. */
+  if (old_empty != NULL)
+    palloc_free_page (old_empty);
+}
+
+/* Prints the number of objects allocated and freed from each
+   cache and the number of pages each holds. */
+void
+kmem_print_stats (void)
+{
+  for (struct kmem_cache *c = all_caches; c != NULL; c = c->next)
+    if (c->alloc_cnt > 0)
+      printf ("Slab: %s: %zu allocated, %zu freed, %zu in use, "
+              "%zu slabs\n",
+              c->name, c->alloc_cnt, c->free_cnt, c->alloc_cnt - c->free_cnt,
+              c->slab_cnt);
+}
+
+/* Obtains a page for a new slab in cache C, constructs its
+   objects, and returns it, or a null pointer if memory is not
+   available. */
+static struct slab *
+new_slab (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free = NULL;
+  s->free_cnt = c->objs_per_slab;
+  for (size_t i = c->objs_per_slab; i-- > 0;)
+    {
+      void *obj = (uint8_t *)s + SLAB_OBJ_OFS + i * c->slot_size;
+      if (c->ctor != NULL)
+        c->ctor (obj);
+      *obj_link (c, obj) = s->free;
+      s->free = obj;
+    }
+  return s;
+}
+
+/* Returns the slab that OBJ, an object from cache C, is in. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid and belongs to C. */
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT (pg_ofs (obj) >= SLAB_OBJ_OFS);
+  ASSERT ((pg_ofs (obj) - SLAB_OBJ_OFS) % c->slot_size == 0);
+
+  return s;
+}
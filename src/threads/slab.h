@@ -0,0 +1,20 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+
+/* Object caches for fixed-size kernel objects.  See slab.c. */
+
+struct kmem_cache;
+
+/* Constructs the object at its argument. */
+typedef void kmem_ctor_func (void *);
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      kmem_ctor_func *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_cache_free_many (struct kmem_cache *, void **, size_t cnt);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
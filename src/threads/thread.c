@@ -435,6 +435,16 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing else is ready to run, so zero free pages ahead of
+         time, one at a time, until something is or there are
+         enough zeroed pages. */
+      intr_enable ();
+      while (list_empty (&ready_list) && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (!list_empty (&ready_list))
+        continue;
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -527,9 +537,20 @@ init_thread (struct thread *t, const char *name, int priority)
   sema_init (&t->ch_load_sema, 0);
 #endif
 #ifdef VM
-  list_init (&t->page_list);
+  t->pages = NULL;
+  list_init (&t->regions);
+  lock_init (&t->page_lock);
   t->user_esp = (void *)0xdeadbeef;
   t->mapid_next = 1;
+  t->rss = 0;
+  if (t != initial_thread)
+    {
+      /* Resident set limits are inherited. */
+      t->rss_soft_limit = thread_current ()->rss_soft_limit;
+      t->rss_hard_limit = thread_current ()->rss_hard_limit;
+    }
+  else
+    t->rss_soft_limit = t->rss_hard_limit = 0;
 #endif
 #ifdef FILESYS
   t->cwd = ROOT_DIR_SECTOR;
@@ -145,9 +145,14 @@ struct thread
   struct file *exec_file; /* Loaded executable file. */
 #endif
 #ifdef VM
-  struct list page_list; /* Pages a user process owns. */
+  struct page ***pages;  /* Supplemental page table, see vm/page.c. */
+  struct list regions;   /* Demand-paged regions, see vm/page.h. */
+  struct lock page_lock; /* Protects PAGES and REGIONS. */
   void *user_esp; /* Stores esp on the transition from user to kernel mode */
   mapid_t mapid_next; /* Next mapid for this process. */
+  size_t rss;            /* Frames mapped, see vm/frame.c. */
+  size_t rss_soft_limit; /* Frames beyond which to evict first, or 0. */
+  size_t rss_hard_limit; /* Frames beyond which to evict own, or 0. */
 #endif
 #ifdef FILESYS
   block_sector_t cwd; /* Current working directory. */
@@ -1,10 +1,12 @@
 #include "userprog/exception.h"
 #include "filesys/filesys.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/gdt.h"
 #include "userprog/process.h"
+#include "userprog/syscall.h"
 #include <inttypes.h>
 #include <stdio.h>
 #ifdef VM
@@ -18,6 +20,7 @@
 static long long page_fault_cnt;
 
 static void kill (struct intr_frame *);
+static void debug_exception (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
@@ -52,7 +55,8 @@ exception_init (void)
      caused indirectly, e.g. #DE can be caused by dividing by
      0.  */
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
-  intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
+  intr_register_int (1, 0, INTR_OFF, debug_exception,
+                     "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
   intr_register_int (7, 0, INTR_ON, kill,
                      "#NM Device Not Available Exception");
@@ -118,6 +122,24 @@ kill (struct intr_frame *f)
     }
 }
 
+/* Debug exception handler.  A user program that single-steps
+   through SYSENTER traps at syscall_fast_entry, before it has
+   switched to its kernel stack.  We clear the trap flag and
+   carry on, with interrupts still off until the switch is made;
+   SYSEXIT doesn't restore EFLAGS, so the program also stops
+   single-stepping.  Anything else is handled by kill(). */
+static void
+debug_exception (struct intr_frame *f)
+{
+  if (f->cs == SEL_KCSEG && f->eip == syscall_fast_entry)
+    {
+      f->eflags &= ~FLAG_TF;
+      return;
+    }
+  intr_enable ();
+  kill (f);
+}
+
 /* Page fault handler.
 
    At entry, the address that faulted is in CR2 (Control Register
@@ -170,7 +192,7 @@ page_fault (struct intr_frame *f)
       && is_user_vaddr (fault_addr) && get_page (fault_addr, t) == NULL)
     {
       /* Stack growth. */
-      if (!page_full_load_stack (stack_bottom))
+      if (!page_full_load_stack (stack_bottom, write))
         goto fail;
       return;
     }
@@ -183,10 +205,12 @@ page_fault (struct intr_frame *f)
 #ifdef VM
       if (not_present)
         {
-          if (!page_full_load (fault_addr))
+          if (!page_full_load (fault_addr, write))
             goto fail;
           return;
         }
+      if (write && page_write_fault (fault_addr))
+        return;
 #endif
       goto fail;
       NOT_REACHED ();
@@ -196,11 +220,16 @@ page_fault (struct intr_frame *f)
       /* We place the conditional compilation here to make syntax highlighting
          work correctly.  */
 #ifdef VM
-      if (!page_full_load (fault_addr))
+      if (!page_full_load (fault_addr, write))
         goto fail;
       return;
 #endif
     }
+#ifdef VM
+  else if (user && write && is_user_vaddr (fault_addr)
+           && page_write_fault (fault_addr))
+    return;
+#endif
 
   /* It's a kernel bug if we reach here. */
   printf ("Page fault at %p: %s error %s page in %s context.\n", fault_addr,
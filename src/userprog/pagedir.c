@@ -24,7 +24,9 @@ pagedir_create (void)
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  With VM, user pages belong to the frame table,
+   which frees them, and some are shared, so only the page tables
+   themselves are freed. */
 void
 pagedir_destroy (uint32_t *pd)
 {
@@ -38,11 +40,13 @@ pagedir_destroy (uint32_t *pd)
     if (*pde & PTE_P)
       {
         uint32_t *pt = pde_get_pt (*pde);
-        uint32_t *pte;
 
+#ifndef VM
+        uint32_t *pte;
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P)
             palloc_free_page (pte_get_page (*pte));
+#endif
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
@@ -6,8 +6,8 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
-#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/gdt.h"
@@ -30,6 +30,9 @@ static bool load (const char *cmdline, void (**eip) (void), void **esp);
 /* A hash table to find exit data from tid. */
 static struct hash hash_exit_data;
 
+/* Cache of struct exit_data. */
+static struct kmem_cache *exit_data_cache;
+
 /* Helper function for hash table. */
 static unsigned tid_hash (tid_t);
 static unsigned hash_func (const struct hash_elem *, void *);
@@ -43,6 +46,8 @@ void
 process_init (void)
 {
   hash_init (&hash_exit_data, hash_func, hash_less, NULL);
+  exit_data_cache = kmem_cache_create ("exit_data", sizeof (struct exit_data),
+                                       NULL);
 }
 
 /* Starts a new thread running a user program loaded from
@@ -100,7 +105,7 @@ process_execute (const char *file_name)
 static bool
 init_exit_data (struct thread *t)
 {
-  struct exit_data *data = malloc (sizeof (struct exit_data));
+  struct exit_data *data = kmem_cache_alloc (exit_data_cache);
   if (data == NULL)
     return false;
   data->tid = t->tid;
@@ -123,7 +128,7 @@ destroy_exit_data (struct exit_data *data)
   enum intr_level old_level = intr_disable ();
   hash_delete (&hash_exit_data, &data->hashelem);
   intr_set_level (old_level);
-  free (data);
+  kmem_cache_free (exit_data_cache, data);
 }
 
 /* A thread function that loads a user process and starts it
@@ -258,20 +263,11 @@ process_exit (int status)
     }
 
 #ifdef VM
-  /* Clear the supplemental pages this process owns. */
-  st = list_begin (&cur->page_list);
-  ed = list_end (&cur->page_list);
-  for (struct list_elem *it = st; it != ed;)
-    {
-      struct page *page = list_entry (it, struct page, listelem);
-      it = list_next (it);
-      ASSERT (page != NULL);
-      page_free (page);
-    }
-
-  /* Clear mmaped files. */
+  /* Clear mmaped files, writing back their dirty pages, then
+     the rest of the supplemental pages this process owns. */
   while (cur->mapid_next)
     syscall_munmap (--cur->mapid_next);
+  page_table_destroy ();
 #endif
 
   /* Destroy the current process's page directory and switch back
@@ -572,6 +568,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* Map the whole segment as one region, loaded on demand. */
+  return page_map (file, ofs, upage, read_bytes, zero_bytes, writable,
+                   PAGE_UNALLOC)
+         != NULL;
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0)
     {
@@ -581,12 +583,6 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-#ifdef VM
-      /* Lazy load this page. */
-      if (!page_lazy_load (file, ofs, upage, page_read_bytes, page_zero_bytes,
-                           writable, PAGE_UNALLOC))
-        return false;
-#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -606,15 +602,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false;
         }
-#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
-      ofs += PGSIZE;
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -625,7 +620,7 @@ setup_stack (void **esp)
   bool success = false;
 
 #ifdef VM
-  success = page_full_load_stack ((uint8_t *)PHYS_BASE - PGSIZE);
+  success = page_full_load_stack ((uint8_t *)PHYS_BASE - PGSIZE, true);
   if (success)
     {
       *esp = PHYS_BASE;
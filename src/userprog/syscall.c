@@ -1,19 +1,26 @@
 #include "userprog/syscall.h"
+#include "devices/block.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
+#include "userprog/tss.h"
+#include "vm/frame.h"
 #include "vm/page.h"
 #include <bitmap.h>
+#include <blockstat.h>
 #include <lib/user/syscall.h>
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include <userprog/pagedir.h>
 
@@ -27,6 +34,7 @@ static struct lock fd_table_lock; /* Mutex protection for fd table access. */
 /* Mmap file table. */
 static struct hash mmap_table;
 static struct lock mmap_table_lock; /* Mutex protection for mmap table. */
+static struct kmem_cache *mmap_data_cache; /* Cache of struct mmap_data. */
 static unsigned hash_func (const struct hash_elem *, void *UNUSED);
 static bool hash_less (const struct hash_elem *, const struct hash_elem *,
                        void *UNUSED);
@@ -58,17 +66,23 @@ static void close_ (int fd);
 #ifdef VM
 static mapid_t mmap_ (int fd, void *addr);
 static void munmap_ (mapid_t mapping);
+static void msync_ (mapid_t mapping);
+static bool madvise_ (void *addr, size_t len, int advice);
+static bool rsslimit_ (size_t soft, size_t hard);
 #endif /* VM */
 static bool chdir_ (const char *dir);
 static bool mkdir_ (const char *dir);
 static bool readdir_ (int fd, char *name);
 static bool isdir_ (int fd);
 static int inumber_ (int fd);
+static bool blockstat_ (int idx, struct blockstat *stats);
 
 void
 syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  if (cpu_features () & CPUID_SEP)
+    tss_enable_sysenter (syscall_fast_entry);
 
   fd_table = bitmap_create (OPEN_FILE_MAX);
   bitmap_set_multiple (fd_table, 0, 2, true);
@@ -79,6 +93,8 @@ syscall_init (void)
 #ifdef VM
   hash_init (&mmap_table, hash_func, hash_less, NULL);
   lock_init (&mmap_table_lock);
+  mmap_data_cache = kmem_cache_create ("mmap_data", sizeof (struct mmap_data),
+                                       NULL);
 #endif /* VM */
 }
 
@@ -122,6 +138,20 @@ is_valid_buf (const void *ptr, size_t size)
   return true;
 }
 
+/* Handles a system call made with SYSENTER, whose number and
+   arguments are on the user stack at ESP, and returns its result.
+   Called by syscall_fast_entry. */
+uint32_t
+syscall_fast_handler (void *esp)
+{
+  struct intr_frame f;
+
+  f.esp = esp;
+  f.eax = 0;
+  syscall_handler (&f);
+  return f.eax;
+}
+
 /* The syscall handler, which is called when the user program pushes data into
    the stack and invokes int $0x30. */
 static void
@@ -272,6 +302,39 @@ syscall_handler (struct intr_frame *f)
         break;
       }
 
+    case SYS_BLOCKSTAT: /* Get block device I/O statistics. */
+      {
+        int idx = READ (f->esp, delta, int);
+        struct blockstat *stats = READ (f->esp, delta, struct blockstat *);
+        if (!is_valid_buf (stats, sizeof *stats))
+          exit_ (-1);
+        f->eax = blockstat_ (idx, stats);
+        break;
+      }
+#ifdef VM
+    case SYS_MSYNC: /* Write back a memory mapped file. */
+      {
+        mapid_t mapping = READ (f->esp, delta, mapid_t);
+        msync_ (mapping);
+        break;
+      }
+    case SYS_MADVISE: /* Give advice about the use of memory. */
+      {
+        void *addr = READ (f->esp, delta, void *);
+        size_t len = READ (f->esp, delta, size_t);
+        int advice = READ (f->esp, delta, int);
+        f->eax = madvise_ (addr, len, advice);
+        break;
+      }
+    case SYS_RSSLIMIT: /* Limit the frames a process may hold. */
+      {
+        size_t soft = READ (f->esp, delta, size_t);
+        size_t hard = READ (f->esp, delta, size_t);
+        f->eax = rsslimit_ (soft, hard);
+        break;
+      }
+#endif /* VM */
+
     default: /* Unkown syscall. */
       exit_ (-1);
     }
@@ -526,41 +589,35 @@ mmap_ (int fd, void *addr)
 
   /* Still invalid input. */
   if (file_size == 0)
-    return -1;
-  for (off_t i = 0; i < file_size; i += PGSIZE)
-    if (get_page (addr + i, cur) != NULL)
+    {
+      file_close (file);
       return -1;
-
-  off_t i;
-  for (i = 0; i < file_size; i += PGSIZE)
+    }
+  uint32_t zero_bytes = ROUND_UP (file_size, PGSIZE) - file_size;
+  struct region *region
+      = page_map (file, 0, addr, file_size, zero_bytes, true, PAGE_FILE);
+  if (region == NULL)
     {
-      uint32_t read_bytes = i + PGSIZE < file_size ? PGSIZE : file_size - i;
-      if (!page_lazy_load (file, i, addr + i, read_bytes, PGSIZE - read_bytes,
-                           true, PAGE_FILE))
-        goto fail;
+      file_close (file);
+      return -1;
     }
 
-  struct mmap_data *mmap_data = malloc (sizeof (struct mmap_data));
+  struct mmap_data *mmap_data = kmem_cache_alloc (mmap_data_cache);
   if (mmap_data == NULL)
-    goto fail;
+    {
+      page_unmap (region);
+      file_close (file);
+      return -1;
+    }
   mmap_data->file = file;
   mmap_data->mapping = cur->mapid_next++;
   mmap_data->owner = cur->tid;
   mmap_data->uaddr = addr;
+  mmap_data->region = region;
   lock_acquire (&mmap_table_lock);
   hash_insert (&mmap_table, &mmap_data->hashelem);
   lock_release (&mmap_table_lock);
   return mmap_data->mapping;
-
-fail:
-  while (i >= 0)
-    {
-      struct page *page = get_page (addr + i, cur);
-      page_free (page);
-      i -= PGSIZE;
-    }
-  file_close (file);
-  return -1;
 }
 
 /* The munmap syscall. */
@@ -572,26 +629,40 @@ munmap_ (mapid_t mapping)
   if (mmap_data == NULL)
     return;
 
-  off_t len = file_length (mmap_data->file);
-  for (off_t i = 0; i < len; i += PGSIZE)
-    {
-      struct page *page = get_page (mmap_data->uaddr + i, cur);
-      ASSERT (page != NULL);
-      if (page->kpage == NULL)
-        page_full_load (mmap_data->uaddr + i);
-      if (pagedir_is_dirty (cur->pagedir, mmap_data->uaddr + i))
-        {
-          file_seek (mmap_data->file, i);
-          file_write (mmap_data->file, page->kpage, page->read_bytes);
-        }
-      page_free (page);
-    }
+  page_sync (mmap_data->region);
+  page_unmap (mmap_data->region);
   file_close (mmap_data->file);
 
   lock_acquire (&mmap_table_lock);
   hash_delete (&mmap_table, &mmap_data->hashelem);
   lock_release (&mmap_table_lock);
-  free (mmap_data);
+  kmem_cache_free (mmap_data_cache, mmap_data);
+}
+
+/* The msync syscall. */
+static void
+msync_ (mapid_t mapping)
+{
+  struct thread *cur = thread_current ();
+  struct mmap_data *mmap_data = hash_query (mapping, cur->tid);
+  if (mmap_data == NULL)
+    return;
+
+  page_sync (mmap_data->region);
+}
+
+/* The madvise syscall. */
+static bool
+madvise_ (void *addr, size_t len, int advice)
+{
+  return page_advise (addr, len, advice);
+}
+
+/* The rsslimit syscall. */
+static bool
+rsslimit_ (size_t soft, size_t hard)
+{
+  return frame_set_rss_limit (soft, hard);
 }
 
 /* Global interface for munmap syscall. */
@@ -699,3 +770,24 @@ inumber_ (int fd)
   lock_release (&fd_table_lock);
   return inode_get_inumber (file_get_inode (open_file));
 }
+
+/* The blockstat syscall.  Copies the statistics of the IDX'th
+   block device, in kernel probe order, into STATS.  Returns false
+   if there is no such device. */
+static bool
+blockstat_ (int idx, struct blockstat *stats)
+{
+  struct blockstat snapshot;
+  struct block *block;
+
+  if (idx < 0)
+    return false;
+  for (block = block_first (); block != NULL && idx > 0; idx--)
+    block = block_next (block);
+  if (block == NULL)
+    return false;
+
+  block_get_stats (block, &snapshot);
+  memcpy (stats, &snapshot, sizeof snapshot);
+  return true;
+}
@@ -14,9 +14,14 @@ struct mmap_data
   struct hash_elem hashelem; /* The hash element in mmap_table. */
   tid_t owner;               /* Owner process of this mapping. */
   void *uaddr;               /* Begin of mapped memory address. */
+  struct region *region;     /* Region of memory it is mapped to. */
 };
 
 void syscall_init (void);
 void syscall_munmap (mapid_t mapping);
 
+/* Fast system calls with SYSENTER. */
+void syscall_fast_entry (void);
+uint32_t syscall_fast_handler (void *esp);
+
 #endif /* userprog/syscall.h */
@@ -1,4 +1,5 @@
 #include "userprog/tss.h"
+#include "threads/cpu.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -47,7 +48,18 @@
    See [IA32-v3a] 6.2.1 "Task-State Segment (TSS)" for a
    description of the TSS.  See [IA32-v3a] 5.12.1 "Exception- or
    Interrupt-Handler Procedures" for a description of when and
-   how stack switching occurs during an interrupt. */
+   how stack switching occurs during an interrupt.
+
+   System calls made with SYSENTER need the same stack, but
+   SYSENTER takes its stack pointer from a model-specific
+   register, which we would rather not rewrite on every thread
+   switch.  Instead, the register points at the TSS's esp0
+   member, and the entry code's first instruction loads the
+   stack pointer from there.  The TSS is put at the end of its
+   page, so that the rest of the page can serve as a stack in the
+   unlikely event that an exception arrives before that
+   instruction runs, e.g. when a user program single-steps
+   through SYSENTER. */
 struct tss
 {
   uint16_t back_link, : 16;
@@ -82,7 +94,8 @@ tss_init (void)
   /* Our TSS is never used in a call gate or task gate, so only a
      few fields of it are ever referenced, and those are the only
      ones we initialize. */
-  tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  uint8_t *page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  tss = (struct tss *)(page + PGSIZE - sizeof *tss);
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
@@ -104,3 +117,19 @@ tss_update (void)
   ASSERT (tss != NULL);
   tss->esp0 = (uint8_t *)thread_current () + PGSIZE;
 }
+
+/* Sets up SYSENTER to enter the kernel at ENTRY, on the stack
+   whose top is stored in the TSS's esp0 member.  SYSEXIT returns
+   to user mode in the segments that follow the kernel's. */
+void
+tss_enable_sysenter (void (*entry) (void))
+{
+  ASSERT (tss != NULL);
+  ASSERT (SEL_KDSEG == SEL_KCSEG + 8);
+  ASSERT (SEL_UCSEG == ((SEL_KCSEG + 16) | 3));
+  ASSERT (SEL_UDSEG == ((SEL_KCSEG + 24) | 3));
+
+  wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+  wrmsr (MSR_SYSENTER_ESP, (uint32_t)&tss->esp0);
+  wrmsr (MSR_SYSENTER_EIP, (uint32_t)entry);
+}
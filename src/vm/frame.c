@@ -3,6 +3,7 @@
 #include "filesys/filesys.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -13,27 +14,93 @@
 
 /* Frame table. */
 static struct lock frame_lock;      /* A lock to protect frame table. */
-static struct hash frame_hash;      /* A hash table to store frames. */
+static struct frame *frames;        /* One for each user pool page. */
+static size_t frame_cnt;            /* Number of elements in FRAMES. */
+static uint8_t *frame_base;         /* Address of the first user page. */
 static struct list frame_list;      /* A list to evict frames. */
 static struct list_elem *clock_ptr; /* Still used to evict frames. */
 
-/* Try to find a frame to evict */
-static void frame_evict (void);
+/* Maximum number of dirty anonymous pages to evict at once.  They
+   are written to consecutive swap slots, which the disk driver
+   merges into a single transfer. */
+#define SWAP_CLUSTER 8
+
+/* Maximum number of frames being written back at once by the
+   page-out thread. */
+#define MAX_CLEANING (4 * SWAP_CLUSTER)
+
+/* Page-out thread.  It is woken when the number of free frames
+   drops below LOW_WATER and reclaims frames until there are
+   HIGH_WATER, so that frame_alloc() rarely has to evict. */
+static size_t low_water, high_water;
+static struct semaphore pageout_sema; /* Up'd to wake the thread. */
+static bool pageout_pending;          /* Woken but not yet run? */
+static thread_func pageout_func NO_RETURN;
+static void wake_pageout (void);
+
+/* Eviction write-back. */
+static size_t evict_cnt;            /* Number of frames EVICTING. */
+static struct condition evict_cond; /* Signaled when one finishes. */
+static struct list done_list;       /* Frames whose swap write is done. */
+static struct semaphore done_sema;  /* Up'd once per frame in done_list. */
+
+static void add_frame (void *kpage, void *upage, struct page *, bool pinned);
+
+/* Try to find frames to evict. */
+static bool frame_evict (void);
+static void evict_own (struct thread *);
+static size_t wsclock (size_t want, size_t max_scan, struct thread *only);
+static struct frame *clock_select (size_t *budget, struct thread *only);
+static bool over_soft_limit (struct frame *);
+static bool frame_is_dirty (struct frame *);
+static bool unmap_frame (struct frame *);
+static void finish_eviction (struct frame *);
+static void swap_out_frames (struct frame **, size_t cnt);
+static block_complete_func swap_write_done;
+static thread_func reaper_func NO_RETURN;
 /* Helper functions for list. */
 static struct list_elem *next_frame_ (void);
-/* Helper functions for hash table. */
-static unsigned hash_func (const struct hash_elem *, void *UNUSED);
-static bool hash_less (const struct hash_elem *, const struct hash_elem *,
-                       void *UNUSED);
+static struct frame_owner *first_owner (struct frame *);
+static struct frame *frame_lookup (void *kpage);
+static void add_owner (struct frame *, void *upage, struct page *);
+static void remove_owner (struct frame *, struct frame_owner *);
+static void drop_owner (struct frame *, struct page *);
+
+/* Page cache, which maps a frame_key to the frame that holds
+   those contents.  Protected by frame_lock. */
+static struct hash page_cache;
+
+/* Cache of struct frame_owner, for frames with several owners. */
+static struct kmem_cache *owner_cache;
+
+static hash_hash_func cache_hash;
+static hash_less_func cache_less;
 
 /* Initializes the frame table. */
 void
 frame_init (void)
 {
-  hash_init (&frame_hash, hash_func, hash_less, NULL);
+  hash_init (&page_cache, cache_hash, cache_less, NULL);
+  owner_cache = kmem_cache_create ("frame_owner", sizeof (struct frame_owner),
+                                   NULL);
+  frame_base = palloc_user_base ();
+  frame_cnt = palloc_user_page_cnt ();
+  frames = calloc (frame_cnt, sizeof *frames);
+  if (frames == NULL)
+    PANIC ("Cannot allocate the frame table");
   list_init (&frame_list);
   clock_ptr = list_begin (&frame_list);
   lock_init (&frame_lock);
+
+  cond_init (&evict_cond);
+  list_init (&done_list);
+  sema_init (&done_sema, 0);
+  thread_create ("reaper", PRI_DEFAULT, reaper_func, NULL);
+
+  low_water = frame_cnt / 64 + 4;
+  high_water = 2 * low_water;
+  sema_init (&pageout_sema, 0);
+  thread_create ("pageout", PRI_DEFAULT, pageout_func, NULL);
 }
 
 /* Allocates a frame from user pool, returns its kernel virtual address.
@@ -46,64 +113,147 @@ frame_alloc (enum palloc_flags flags, void *upage, struct page *page,
   ASSERT (is_user_vaddr (upage));
 
   lock_acquire (&frame_lock);
-  void *kpage = palloc_get_page (flags | PAL_USER);
-  if (kpage == NULL)
+  struct thread *t = thread_current ();
+  if (t->rss_hard_limit != 0 && t->rss >= t->rss_hard_limit)
+    evict_own (t);
+
+  void *kpage;
+  while ((kpage = palloc_get_page (flags | PAL_USER)) == NULL)
     {
-      frame_evict ();
-      kpage = palloc_get_page (flags | PAL_USER);
+      /* Frames already being written back will be free soon, so
+         wait for them rather than evicting more. */
+      wake_pageout ();
+      if (evict_cnt > 0)
+        cond_wait (&evict_cond, &frame_lock);
+      else if (!frame_evict ())
+        PANIC ("Cannot evict a frame");
     }
-  if (kpage == NULL)
-    PANIC ("Cannot evict a frame");
-  struct frame *frame = (struct frame *)malloc (sizeof (struct frame));
-  struct frame_owner *owner
-      = (struct frame_owner *)malloc (sizeof (struct frame_owner));
-  frame->kpage = kpage;
-  frame->pinned = pinned;
-  list_init (&frame->owner_list);
-  owner->upage = upage;
-  owner->thread = thread_current ();
-  owner->sup_page = page;
-  list_push_back (&frame->owner_list, &owner->listelem);
-  hash_insert (&frame_hash, &frame->hashelem);
-  list_insert (clock_ptr, &frame->listelem);
+  add_frame (kpage, upage, page, pinned);
+  if (palloc_user_free_cnt () < low_water)
+    wake_pageout ();
   lock_release (&frame_lock);
   return kpage;
 }
 
-/* Share the frame at KPAGE with page PAGE. */
-void
-frame_share (void *kpage, void *upage, struct page *page)
+/* Like frame_alloc(), but returns a null pointer instead of
+   evicting a frame, or dipping into the page-out thread's reserve,
+   if few frames are free, or if the current process is at its
+   soft or hard resident set limit. */
+void *
+frame_try_alloc (enum palloc_flags flags, void *upage, struct page *page,
+                 bool pinned)
 {
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (is_user_vaddr (upage));
 
   lock_acquire (&frame_lock);
+  struct thread *t = thread_current ();
+  void *kpage = NULL;
+  if (palloc_user_free_cnt () > low_water
+      && (t->rss_soft_limit == 0 || t->rss < t->rss_soft_limit)
+      && (t->rss_hard_limit == 0 || t->rss < t->rss_hard_limit))
+    kpage = palloc_get_page (flags | PAL_USER);
+  if (kpage != NULL)
+    add_frame (kpage, upage, page, pinned);
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Adds a frame for KPAGE, owned by PAGE at UPAGE in the current
+   thread, to the frame table. */
+static void
+add_frame (void *kpage, void *upage, struct page *page, bool pinned)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  struct frame *frame = frame_lookup (kpage);
+  ASSERT (frame->kpage == NULL);
+  frame->kpage = kpage;
+  frame->pinned = pinned;
+  frame->evicting = false;
+  frame->cached = false;
+  list_init (&frame->owner_list);
+  add_owner (frame, upage, page);
+  list_insert (clock_ptr, &frame->listelem);
+}
+
+/* Returns a block request embedded in the frame at KPAGE, which
+   the frame's owner may use to read the frame in while it is
+   pinned. */
+struct block_request *
+frame_request (void *kpage)
+{
+  ASSERT (pg_ofs (kpage) == 0);
+
+  lock_acquire (&frame_lock);
+  struct frame *frame = frame_lookup (kpage);
+  ASSERT (frame->kpage != NULL);
+  ASSERT (frame->pinned && !frame->evicting);
+  lock_release (&frame_lock);
+  return &frame->io;
+}
+
+/* Looks up the page cache for a frame holding the contents
+   identified by KEY.  If there is one, maps it into PAGE's owner
+   at PAGE's address, makes PAGE one of its owners, and returns
+   true.  Otherwise, returns false.  If the frame is being
+   evicted, waits for that to finish if WAIT is true, or just
+   returns false otherwise. */
+bool
+frame_share_cached (const struct frame_key *key, struct page *page,
+                    bool wait)
+{
   struct frame tmp;
-  tmp.kpage = kpage;
-  struct hash_elem *elem = hash_find (&frame_hash, &tmp.hashelem);
-  ASSERT (elem != NULL);
-  struct frame *frame = hash_entry (elem, struct frame, hashelem);
-  struct frame_owner *owner
-      = (struct frame_owner *)malloc (sizeof (struct frame_owner));
-  owner->upage = upage;
-  owner->thread = thread_current ();
-  owner->sup_page = page;
-  list_push_back (&frame->owner_list, &owner->listelem);
+  tmp.key = *key;
 
-#ifdef DEBUG
-  printf ("frame_share: kpage = %p\n", kpage);
-  struct list_elem *st = list_begin (&frame->owner_list);
-  struct list_elem *ed = list_end (&frame->owner_list);
-  for (struct list_elem *it = st; it != ed; it = list_next (it))
+  lock_acquire (&frame_lock);
+  struct frame *frame;
+  for (;;)
     {
-      struct frame_owner *owner
-          = list_entry (it, struct frame_owner, listelem);
-      printf ("frame_share: upage = %p, tid = %d\n", owner->upage,
-              owner->thread->tid);
+      struct hash_elem *elem = hash_find (&page_cache, &tmp.cacheelem);
+      if (elem == NULL)
+        {
+          lock_release (&frame_lock);
+          return false;
+        }
+      frame = hash_entry (elem, struct frame, cacheelem);
+      if (!frame->evicting)
+        break;
+      if (!wait)
+        {
+          lock_release (&frame_lock);
+          return false;
+        }
+
+      /* Its contents may be on their way back to the file. */
+      cond_wait (&evict_cond, &frame_lock);
     }
-  printf ("\n");
-#endif
 
+  /* Map it while holding frame_lock, so that it can't be evicted
+     before PAGE is bound to it. */
+  bool success = pagedir_install_page (page->owner, page->upage,
+                                       frame->kpage, page->writable);
+  if (success)
+    {
+      add_owner (frame, page->upage, page);
+      page->kpage = frame->kpage;
+    }
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* Enters the frame at KPAGE, which has been loaded with the
+   contents identified by KEY, in the page cache.  Does nothing if
+   another frame with the same contents got there first. */
+void
+frame_cache (void *kpage, const struct frame_key *key)
+{
+  lock_acquire (&frame_lock);
+  struct frame *frame = frame_lookup (kpage);
+  ASSERT (frame->kpage != NULL && !frame->cached);
+  frame->key = *key;
+  if (hash_insert (&page_cache, &frame->cacheelem) == NULL)
+    frame->cached = true;
   lock_release (&frame_lock);
 }
 
@@ -118,29 +268,33 @@ frame_free (void *kpage)
   bool lock_already_held = lock_held_by_current_thread (&frame_lock);
   if (!lock_already_held)
     lock_acquire (&frame_lock);
-  struct frame tmp;
-  tmp.kpage = kpage;
-  struct hash_elem *elem = hash_delete (&frame_hash, &tmp.hashelem);
-  if (elem == NULL)
+  struct frame *frame = frame_lookup (kpage);
+  if (frame->kpage == NULL)
     {
       if (!lock_already_held)
         lock_release (&frame_lock);
       return;
     }
-  struct frame *frame = hash_entry (elem, struct frame, hashelem);
   if (clock_ptr == &frame->listelem)
     clock_ptr = next_frame_ ();
 
   ASSERT (list_empty (&frame->owner_list));
 
+  if (frame->cached)
+    {
+      hash_delete (&page_cache, &frame->cacheelem);
+      frame->cached = false;
+    }
   palloc_free_page (frame->kpage);
   list_remove (&frame->listelem);
-  free (frame);
+  frame->kpage = NULL;
   if (!lock_already_held)
     lock_release (&frame_lock);
 }
 
-/* Change pinned status of frame at KPAGE to STATUS atomically. */
+/* Change pinned status of frame at KPAGE to STATUS atomically.
+   The frame must not be being evicted; to pin a page that may
+   be, use frame_pin_resident(). */
 void
 frame_set_pinned (void *kpage, bool status)
 {
@@ -150,17 +304,35 @@ frame_set_pinned (void *kpage, bool status)
   if (!lock_already_held)
     lock_acquire (&frame_lock);
   enum intr_level old_level = intr_disable ();
-  struct frame tmp;
-  tmp.kpage = kpage;
-  struct hash_elem *elem = hash_find (&frame_hash, &tmp.hashelem);
-  ASSERT (elem != NULL);
-  struct frame *frame = hash_entry (elem, struct frame, hashelem);
+  struct frame *frame = frame_lookup (kpage);
+  ASSERT (frame->kpage != NULL);
+  ASSERT (!frame->evicting);
   frame->pinned = status;
   intr_set_level (old_level);
   if (!lock_already_held)
     lock_release (&frame_lock);
 }
 
+/* Sets the current process's resident set limits, in frames, to
+   SOFT and HARD; 0 means no limit.  Frames of a process over its
+   soft limit are evicted before others, and a process at its hard
+   limit evicts its own frames to get more.  The limits are
+   inherited by processes it creates.  Returns false, without
+   changing anything, if SOFT is more than a nonzero HARD. */
+bool
+frame_set_rss_limit (size_t soft, size_t hard)
+{
+  if (hard != 0 && soft > hard)
+    return false;
+
+  struct thread *t = thread_current ();
+  lock_acquire (&frame_lock);
+  t->rss_soft_limit = soft;
+  t->rss_hard_limit = hard;
+  lock_release (&frame_lock);
+  return true;
+}
+
 /* Returns the frame after clock_ptr in frame_list. */
 static struct list_elem *
 next_frame_ (void)
@@ -172,25 +344,152 @@ next_frame_ (void)
     return list_next (clock_ptr);
 }
 
-/* Evicts a frame from the frame table. */
-static void
+/* Returns the first owner of frame F. */
+static struct frame_owner *
+first_owner (struct frame *f)
+{
+  ASSERT (!list_empty (&f->owner_list));
+  return list_entry (list_begin (&f->owner_list), struct frame_owner,
+                     listelem);
+}
+
+/* Direct reclaim, for when there is no free frame at all. */
+static bool
 frame_evict (void)
+{
+  return wsclock (SWAP_CLUSTER, 3 * list_size (&frame_list), NULL) > 0;
+}
+
+/* Evicts one of the frames mapped only by T, which is at its
+   hard resident set limit, so that T replaces its own pages
+   instead of taking other processes' frames.  Frames being
+   written back still count against T until the write finishes,
+   so T may briefly hold more than its limit. */
+static void
+evict_own (struct thread *t)
+{
+  wsclock (1, 2 * list_size (&frame_list), t);
+}
+
+/* Runs the WSClock hand over at most MAX_SCAN frames to reclaim
+   up to WANT of them, and returns the number reclaimed.  If ONLY
+   is nonnull, considers only frames mapped by ONLY alone.
+
+   A frame referenced since the hand last passed it gets another
+   chance.  An unreferenced frame that has not been modified is
+   freed at once.  A dirty one is scheduled for cleaning, unless
+   MAX_CLEANING frames are being written back already, and is
+   freed when its write completes.  Anonymous pages go to swap
+   asynchronously, in clusters of up to SWAP_CLUSTER that get
+   consecutive swap slots, and the reaper thread frees their
+   frames.  A file-backed page is written to its file before the
+   hand moves on.  frame_lock is released during I/O. */
+static size_t
+wsclock (size_t want, size_t max_scan, struct thread *only)
+{
+  struct frame *swap_victims[SWAP_CLUSTER];
+  size_t swap_cnt = 0;
+  size_t cnt = 0;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  while (cnt < want)
+    {
+      struct frame *victim = clock_select (&max_scan, only);
+      if (victim == NULL)
+        break;
+      if (evict_cnt >= MAX_CLEANING && frame_is_dirty (victim))
+        continue;
+
+      /* Pages modified since load should be written to swap; while
+         unmodified pages should never be written to swap. */
+      struct frame_owner *victim_owner = first_owner (victim);
+      ASSERT (victim_owner->upage == victim_owner->sup_page->upage);
+      cnt++;
+      if (!unmap_frame (victim))
+        {
+          /* A clean anonymous page that was read in from swap
+             still has its contents there; any other goes back to
+             being loaded afresh. */
+          if (victim_owner->sup_page->type == PAGE_ALLOC)
+            {
+              struct list_elem *st = list_begin (&victim->owner_list);
+              struct list_elem *ed = list_end (&victim->owner_list);
+              for (struct list_elem *it = st; it != ed; it = list_next (it))
+                {
+                  struct frame_owner *owner
+                      = list_entry (it, struct frame_owner, listelem);
+                  if (owner->sup_page->slot_idx == SLOT_ERR)
+                    owner->sup_page->type = PAGE_UNALLOC;
+                }
+            }
+          finish_eviction (victim);
+          continue;
+        }
+
+      victim->evicting = true;
+      evict_cnt++;
+
+      /* Nobody else touches the owners of a frame being evicted,
+         so frame_lock is not needed to write it back. */
+      if (victim_owner->sup_page->type == PAGE_FILE)
+        {
+          struct page *page = victim_owner->sup_page;
+          lock_release (&frame_lock);
+          file_write_at (page->file, victim->kpage, page->read_bytes,
+                         page->ofs);
+          lock_acquire (&frame_lock);
+          finish_eviction (victim);
+          continue;
+        }
+      ASSERT (victim_owner->sup_page->type == PAGE_ALLOC);
+      swap_victims[swap_cnt++] = victim;
+      if (swap_cnt == SWAP_CLUSTER)
+        {
+          lock_release (&frame_lock);
+          swap_out_frames (swap_victims, swap_cnt);
+          lock_acquire (&frame_lock);
+          swap_cnt = 0;
+        }
+    }
+
+  if (swap_cnt > 0)
+    {
+      lock_release (&frame_lock);
+      swap_out_frames (swap_victims, swap_cnt);
+      lock_acquire (&frame_lock);
+    }
+  return cnt;
+}
+
+/* Advances the clock hand, clearing accessed bits as it goes,
+   and returns the first frame that is neither pinned, being
+   evicted, nor recently accessed.  A frame whose owners are all
+   over their soft resident set limits gets no second chance for
+   having been accessed, so that processes over their limits lose
+   frames first.  If ONLY is nonnull, skips frames not mapped by
+   ONLY alone.  Passes over at most *BUDGET frames, decrementing
+   *BUDGET for each one.  Returns NULL if there is none. */
+static struct frame *
+clock_select (size_t *budget, struct thread *only)
 {
   ASSERT (lock_held_by_current_thread (&frame_lock));
 
   if (list_empty (&frame_list))
-    return;
-  struct frame *victim = NULL;
-  if (clock_ptr == NULL)
+    return NULL;
+  if (clock_ptr == NULL || clock_ptr == list_end (&frame_list))
     clock_ptr = list_begin (&frame_list);
-  for (int cycle_cnt = 0; cycle_cnt <= 2;)
+  while (*budget > 0)
     {
-      if (clock_ptr == list_begin (&frame_list))
-        ++cycle_cnt;
       struct frame *f = list_entry (clock_ptr, struct frame, listelem);
       clock_ptr = next_frame_ ();
+      --*budget;
 
-      if (f->pinned)
+      if (f->pinned || f->evicting)
+        continue;
+      if (only != NULL
+          && (list_size (&f->owner_list) != 1
+              || first_owner (f)->thread != only))
         continue;
 
       struct list_elem *st = list_begin (&f->owner_list);
@@ -207,118 +506,371 @@ frame_evict (void)
               is_accessed = true;
             }
         }
-      if (is_accessed)
-        continue;
+      if (!is_accessed || over_soft_limit (f))
+        return f;
+    }
+  return NULL;
+}
 
-      victim = f;
-      break;
+/* Returns true if every owner of frame F is over its soft
+   resident set limit. */
+static bool
+over_soft_limit (struct frame *f)
+{
+  struct list_elem *st = list_begin (&f->owner_list);
+  struct list_elem *ed = list_end (&f->owner_list);
+  for (struct list_elem *it = st; it != ed; it = list_next (it))
+    {
+      struct thread *t = list_entry (it, struct frame_owner, listelem)->thread;
+      if (t->rss_soft_limit == 0 || t->rss <= t->rss_soft_limit)
+        return false;
     }
-  if (victim == NULL)
-    return;
+  return true;
+}
 
-  /* Pages modified since load should be written to swap; while unmodified
-     pages should never be written to swap. */
-  struct frame_owner *victim_owner = list_entry (
-      list_begin (&victim->owner_list), struct frame_owner, listelem);
-  ASSERT (victim_owner->upage == victim_owner->sup_page->upage);
-  if (victim_owner->sup_page->type == PAGE_ALLOC)
+/* Returns true if any owner of frame F has modified it. */
+static bool
+frame_is_dirty (struct frame *f)
+{
+  struct list_elem *st = list_begin (&f->owner_list);
+  struct list_elem *ed = list_end (&f->owner_list);
+  for (struct list_elem *it = st; it != ed; it = list_next (it))
     {
-      if (pagedir_is_dirty (victim_owner->thread->pagedir,
-                            victim_owner->upage))
-        {
-          /* According to pintos document, we can panic if the swap is full. */
-          slot_id slot_idx = swap_out (victim->kpage);
-          if (slot_idx == SLOT_ERR)
-            PANIC ("swap is full");
-          victim_owner->sup_page->slot_idx = slot_idx;
-        }
-      else
-        {
-          struct list_elem *st = list_begin (&victim->owner_list);
-          struct list_elem *ed = list_end (&victim->owner_list);
-          for (struct list_elem *it = st; it != ed; it = list_next (it))
-            {
-              struct frame_owner *owner
-                  = list_entry (it, struct frame_owner, listelem);
-              owner->sup_page->type = PAGE_UNALLOC;
-              owner->sup_page->slot_idx = SLOT_ERR;
-            }
-        }
+      struct frame_owner *owner
+          = list_entry (it, struct frame_owner, listelem);
+      if (pagedir_is_dirty (owner->thread->pagedir, owner->upage))
+        return true;
     }
-  else
+  return false;
+}
+
+/* Removes frame F from its owners' page directories.  Returns
+   true if any of them had modified it. */
+static bool
+unmap_frame (struct frame *f)
+{
+  bool dirty = false;
+
+  struct list_elem *st = list_begin (&f->owner_list);
+  struct list_elem *ed = list_end (&f->owner_list);
+  for (struct list_elem *it = st; it != ed; it = list_next (it))
     {
-      ASSERT (victim_owner->sup_page->type == PAGE_FILE);
-      if (pagedir_is_dirty (victim_owner->thread->pagedir,
-                            victim_owner->upage))
-        {
-          file_write_at (victim_owner->sup_page->file, victim->kpage,
-                         victim_owner->sup_page->read_bytes,
-                         victim_owner->sup_page->ofs);
-          pagedir_set_dirty (victim_owner->thread->pagedir,
-                             victim_owner->upage, false);
-        }
+      struct frame_owner *owner
+          = list_entry (it, struct frame_owner, listelem);
+      uint32_t *pd = owner->thread->pagedir;
+
+      /* Keep the owner from dirtying the page between the check
+         and the unmapping. */
+      enum intr_level old_level = intr_disable ();
+      if (pagedir_is_dirty (pd, owner->upage))
+        dirty = true;
+      pagedir_clear_page (pd, owner->upage);
+      intr_set_level (old_level);
     }
+  return dirty;
+}
+
+/* Unbinds frame F, which has been unmapped and written back if
+   necessary, from its owners' pages and frees it. */
+static void
+finish_eviction (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
 
-  /* Unbound the page from the frame. */
-  struct list_elem *st = list_begin (&victim->owner_list);
-  struct list_elem *ed = list_end (&victim->owner_list);
+  struct list_elem *st = list_begin (&f->owner_list);
+  struct list_elem *ed = list_end (&f->owner_list);
   for (struct list_elem *it = st; it != ed;)
     {
       struct frame_owner *owner
           = list_entry (it, struct frame_owner, listelem);
       it = list_next (it);
-      pagedir_clear_page (owner->thread->pagedir, owner->upage);
       owner->sup_page->kpage = NULL;
-      list_remove (&owner->listelem);
-      free (owner);
+      remove_owner (f, owner);
+    }
+  if (f->evicting)
+    {
+      evict_cnt--;
+      cond_broadcast (&evict_cond, &frame_lock);
     }
-  /* Free the frame. */
-  frame_free (victim->kpage);
+  frame_free (f->kpage);
 }
 
-/* Removes the share of page PAGE to frame. If this is the last share, free the
-   frame. */
+/* Starts writing the CNT frames in FRAMES, which hold dirty
+   anonymous pages, to swap.  They get consecutive slots if
+   possible, so that the writes can be merged. */
+static void
+swap_out_frames (struct frame **victims, size_t cnt)
+{
+  /* A page read in from swap kept its old slot, whose contents
+     are now stale. */
+  for (size_t i = 0; i < cnt; i++)
+    {
+      struct page *page = first_owner (victims[i])->sup_page;
+      if (page->slot_idx != SLOT_ERR)
+        {
+          swap_free (page->slot_idx);
+          page->slot_idx = SLOT_ERR;
+        }
+    }
+
+  slot_id first = swap_alloc (cnt);
+  for (size_t i = 0; i < cnt; i++)
+    {
+      struct frame *f = victims[i];
+      slot_id slot_idx = first != SLOT_ERR ? first + i : swap_alloc (1);
+
+      /* According to pintos document, we can panic if the swap is full. */
+      if (slot_idx == SLOT_ERR)
+        PANIC ("swap is full");
+      struct frame_owner *owner = first_owner (f);
+      owner->sup_page->slot_idx = slot_idx;
+      swap_write (slot_idx, f->kpage, owner->thread->tid, owner->upage,
+                  &f->io, swap_write_done, f);
+    }
+}
+
+/* Called when a frame's swap write completes, possibly in
+   interrupt context.  Hands the frame to the reaper thread, which
+   can take frame_lock. */
+static void
+swap_write_done (struct block_request *request)
+{
+  enum intr_level old_level = intr_disable ();
+  list_push_back (&done_list, &request->elem);
+  intr_set_level (old_level);
+  sema_up (&done_sema);
+}
+
+/* Reaper thread.  Frees frames whose swap writes have completed. */
+static void
+reaper_func (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&done_sema);
+
+      enum intr_level old_level = intr_disable ();
+      struct list_elem *e = list_pop_front (&done_list);
+      intr_set_level (old_level);
+      struct block_request *request
+          = list_entry (e, struct block_request, elem);
+
+      lock_acquire (&frame_lock);
+      finish_eviction (request->aux);
+      lock_release (&frame_lock);
+    }
+}
+
+/* Wakes up the page-out thread, if it isn't already awake. */
+static void
+wake_pageout (void)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (!pageout_pending)
+    {
+      pageout_pending = true;
+      sema_up (&pageout_sema);
+    }
+}
+
+/* Page-out thread.  Refills the reserve of free frames, counting
+   those being written back, up to HIGH_WATER. */
+static void
+pageout_func (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&pageout_sema);
+
+      lock_acquire (&frame_lock);
+      pageout_pending = false;
+      size_t free_cnt = palloc_user_free_cnt () + evict_cnt;
+      if (free_cnt < high_water)
+        wsclock (high_water - free_cnt, 2 * list_size (&frame_list), NULL);
+      lock_release (&frame_lock);
+    }
+}
+
+/* Waits until PAGE is no longer being evicted.  Afterward, PAGE
+   is either resident and mapped or has no frame at all. */
 void
-frame_remove (struct page *page)
+frame_wait_evicted (struct page *page)
 {
   lock_acquire (&frame_lock);
-  struct frame tmp;
-  tmp.kpage = page->kpage;
-  struct hash_elem *elem = hash_find (&frame_hash, &tmp.hashelem);
-  ASSERT (elem != NULL);
-  struct frame *frame = hash_entry (elem, struct frame, hashelem);
-  struct list_elem *st = list_begin (&frame->owner_list);
-  struct list_elem *ed = list_end (&frame->owner_list);
-  for (struct list_elem *it = st; it != ed;)
+  while (page->kpage != NULL && frame_lookup (page->kpage)->evicting)
+    cond_wait (&evict_cond, &frame_lock);
+  lock_release (&frame_lock);
+}
+
+/* Waits until PAGE is no longer being evicted and, if it is
+   still resident, pins its frame, without releasing frame_lock
+   in between, so that the frame cannot be chosen for eviction
+   after the wait.  Returns true if PAGE's frame was pinned, false
+   if PAGE has no frame. */
+bool
+frame_pin_resident (struct page *page)
+{
+  lock_acquire (&frame_lock);
+  while (page->kpage != NULL && frame_lookup (page->kpage)->evicting)
+    cond_wait (&evict_cond, &frame_lock);
+  bool resident = page->kpage != NULL;
+  if (resident)
+    frame_lookup (page->kpage)->pinned = true;
+  lock_release (&frame_lock);
+  return resident;
+}
+
+/* Returns true if any owner of the frame at KPAGE, which must be
+   pinned, has modified it since the last call, and marks it
+   unmodified for all of them.  A frame shared through the page
+   cache holds changes made through every owner's mapping, so all
+   of them have to be checked before writing it back. */
+bool
+frame_clear_dirty (void *kpage)
+{
+  lock_acquire (&frame_lock);
+  struct frame *f = frame_lookup (kpage);
+  ASSERT (f->kpage != NULL && f->pinned);
+  bool dirty = false;
+  struct list_elem *st = list_begin (&f->owner_list);
+  struct list_elem *ed = list_end (&f->owner_list);
+  for (struct list_elem *it = st; it != ed; it = list_next (it))
     {
       struct frame_owner *owner
           = list_entry (it, struct frame_owner, listelem);
-      if (owner->sup_page == page)
+      if (pagedir_is_dirty (owner->thread->pagedir, owner->upage))
         {
-          it = list_remove (it);
-          free (owner);
-          break;
+          pagedir_set_dirty (owner->thread->pagedir, owner->upage, false);
+          dirty = true;
         }
-      else
-        it = list_next (it);
     }
+  lock_release (&frame_lock);
+  return dirty;
+}
+
+/* Removes the share of page PAGE to frame. If this is the last share, free the
+   frame.  Otherwise, unpins it, since the caller pins the frame while
+   removing PAGE from it. */
+void
+frame_remove (struct page *page)
+{
+  lock_acquire (&frame_lock);
+  struct frame *frame = frame_lookup (page->kpage);
+  ASSERT (frame->kpage != NULL);
+  drop_owner (frame, page);
   if (list_empty (&frame->owner_list))
     frame_free (frame->kpage);
+  else
+    frame->pinned = false;
   lock_release (&frame_lock);
 }
 
+/* Removes the CNT pages in PAGES, which belong to the current
+   process as it exits, from the frames that hold them, freeing
+   each frame that is left with no owners, all under a single
+   acquisition of frame_lock.  Waits for any that are being
+   evicted first; afterward, those have no frame, only a swap
+   slot.
+
+   The pages' page table entries are left as they are, because
+   the process's page directory is about to be destroyed without
+   being used again, and clearing each would flush the TLB. */
+void
+frame_release_pages (struct page **pages, size_t cnt)
+{
+  lock_acquire (&frame_lock);
+  for (size_t i = 0; i < cnt; i++)
+    {
+      struct page *page = pages[i];
+      while (page->kpage != NULL && frame_lookup (page->kpage)->evicting)
+        cond_wait (&evict_cond, &frame_lock);
+      if (page->kpage == NULL)
+        continue;
+
+      struct frame *frame = frame_lookup (page->kpage);
+      drop_owner (frame, page);
+      if (list_empty (&frame->owner_list))
+        frame_free (frame->kpage);
+      page->kpage = NULL;
+    }
+  lock_release (&frame_lock);
+}
+
+/* Removes PAGE from frame F's owners. */
+static void
+drop_owner (struct frame *f, struct page *page)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->owner_list); e != list_end (&f->owner_list);
+       e = list_next (e))
+    {
+      struct frame_owner *owner = list_entry (e, struct frame_owner, listelem);
+      if (owner->sup_page == page)
+        {
+          remove_owner (f, owner);
+          return;
+        }
+    }
+}
+
+/* Adds PAGE, mapped at UPAGE by the current thread, to frame F's
+   owners. */
+static void
+add_owner (struct frame *f, void *upage, struct page *page)
+{
+  struct frame_owner *owner = &f->owner;
+  if (owner->sup_page != NULL)
+    owner = kmem_cache_alloc (owner_cache);
+  owner->upage = upage;
+  owner->thread = thread_current ();
+  owner->sup_page = page;
+  list_push_back (&f->owner_list, &owner->listelem);
+  owner->thread->rss++;
+}
+
+/* Returns the descriptor for the user pool page at KPAGE. */
+static struct frame *
+frame_lookup (void *kpage)
+{
+  size_t idx = ((uint8_t *)kpage - frame_base) / PGSIZE;
+  ASSERT (idx < frame_cnt);
+  return &frames[idx];
+}
+
+/* Removes OWNER from frame F's owners and frees it. */
+static void
+remove_owner (struct frame *f, struct frame_owner *owner)
+{
+  owner->thread->rss--;
+  list_remove (&owner->listelem);
+  if (owner == &f->owner)
+    owner->sup_page = NULL;
+  else
+    kmem_cache_free (owner_cache, owner);
+}
+
+/* Hash function for the page cache. */
 static unsigned
-hash_func (const struct hash_elem *elem, void *aux UNUSED)
+cache_hash (const struct hash_elem *elem, void *aux UNUSED)
 {
-  const struct frame *frame = hash_entry (elem, struct frame, hashelem);
-  return hash_bytes (&frame->kpage, sizeof (frame->kpage));
+  const struct frame *f = hash_entry (elem, struct frame, cacheelem);
+  return hash_int (f->key.inumber) ^ hash_int (f->key.ofs);
 }
 
+/* Comparison function for the page cache. */
 static bool
-hash_less (const struct hash_elem *lhs, const struct hash_elem *rhs,
-           void *aux UNUSED)
+cache_less (const struct hash_elem *lhs, const struct hash_elem *rhs,
+            void *aux UNUSED)
 {
-  const struct frame *lhs_ = hash_entry (lhs, struct frame, hashelem);
-  const struct frame *rhs_ = hash_entry (rhs, struct frame, hashelem);
-  return (uintptr_t)lhs_->kpage < (uintptr_t)rhs_->kpage;
+  const struct frame_key *l = &hash_entry (lhs, struct frame, cacheelem)->key;
+  const struct frame_key *r = &hash_entry (rhs, struct frame, cacheelem)->key;
+  if (l->inumber != r->inumber)
+    return l->inumber < r->inumber;
+  if (l->ofs != r->ofs)
+    return l->ofs < r->ofs;
+  if (l->read_bytes != r->read_bytes)
+    return l->read_bytes < r->read_bytes;
+  return l->mmap < r->mmap;
 }
@@ -1,11 +1,24 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include "devices/block.h"
+#include "filesys/off_t.h"
 #include "threads/palloc.h"
 #include "vm/page.h"
 #include <hash.h>
+#include <list.h>
 #include <stdbool.h>
 
+/* Identifies file contents that processes can share a frame for:
+   a read-only page of an executable or a page of a mapped file. */
+struct frame_key
+{
+  block_sector_t inumber; /* Inode sector of the file. */
+  off_t ofs;              /* Offset of the page within the file. */
+  uint32_t read_bytes;    /* Bytes read from the file; the rest are 0. */
+  bool mmap;              /* Mapped with mmap, not loaded by exec. */
+};
+
 struct frame_owner
 {
   void *upage;               /* Address returned to user. */
@@ -14,20 +27,44 @@ struct frame_owner
   struct list_elem listelem; /* The list element in owner_list. */
 };
 
+/* A frame descriptor.  There is one for each page in the user
+   pool, found by page number, so the descriptor of a frame in
+   use is never allocated or looked up in a table. */
 struct frame
 {
-  void *kpage;               /* Address returned by palloc. */
+  void *kpage;               /* Address returned by palloc, or null if free. */
   bool pinned;               /* Whether this frame can be evicted. */
-  struct hash_elem hashelem; /* The hash element in frame_hash. */
   struct list_elem listelem; /* The list element in frame_list. */
   struct list owner_list;    /* List of owners of this frame. */
+  struct frame_owner owner;  /* First owner, which is usually the only one. */
+
+  /* Page cache.  A frame holding shareable file contents is
+     entered in the page cache under KEY once loaded. */
+  bool cached;                /* In the page cache? */
+  struct frame_key key;       /* Contents, if CACHED. */
+  struct hash_elem cacheelem; /* Element in the page cache. */
+
+  /* Eviction.  While EVICTING, the frame's contents are being
+     written back and its owners are unmapped, but their pages
+     still point to it until the write completes. */
+  bool evicting;              /* Being written back. */
+  struct block_request io;    /* Swap write, or read while loading. */
 };
 
 void frame_init (void);
 void *frame_alloc (enum palloc_flags, void *, struct page *, bool);
+void *frame_try_alloc (enum palloc_flags, void *, struct page *, bool);
+struct block_request *frame_request (void *);
 void frame_free (void *);
 void frame_set_pinned (void *, bool);
-void frame_share (void *, void *, struct page *);
+bool frame_share_cached (const struct frame_key *, struct page *,
+                         bool wait);
+void frame_cache (void *, const struct frame_key *);
 void frame_remove (struct page *);
+void frame_release_pages (struct page **, size_t cnt);
+void frame_wait_evicted (struct page *);
+bool frame_pin_resident (struct page *);
+bool frame_clear_dirty (void *);
+bool frame_set_rss_limit (size_t soft, size_t hard);
 
 #endif /* vm/frame.h */
@@ -1,92 +1,384 @@
 #include "vm/page.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/pte.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
 #include <debug.h>
-#include <hash.h>
+#include <madvise.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 
-/* The supplemental page table. */
-static struct hash sup_page_table;
+/* Each process has its own supplemental page table, which
+   mirrors the two-level x86 page table: the page directory index
+   of a user address selects a table, allocated on demand, in
+   which its page table index selects a pointer to the struct
+   page.  A process's table is protected by its page_lock. */
+typedef struct page *page_table_t[PGSIZE / sizeof (struct page *)];
 
-/* The lock for the supplemental page table. */
-static struct lock sup_page_table_lock;
+/* A page of zeros, mapped read-only into every process in place
+   of zero-filled pages that have only been read. */
+static void *zero_page;
 
-/* Helper functions for hash table. */
-static unsigned hash_func (const struct hash_elem *, void *UNUSED);
-static bool hash_less (const struct hash_elem *, const struct hash_elem *,
-                       void *UNUSED);
+/* Cache of struct page. */
+static struct kmem_cache *spt_cache;
 
+static bool map_zero_page (struct page *);
+static struct page **lookup_entry (struct thread *, const void *upage,
+                                   bool create);
+static bool insert_page (struct page *);
+static void remove_page (struct page *);
+static void release_page (struct page *);
+static void release_pages (struct page **, size_t cnt);
+
+/* Maximum number of extra pages read in along with a swapped-out
+   page that faults. */
+#define READ_AROUND_MAX 8
+
+/* Maximum number of pages written back by a single write when a
+   mapping is synced. */
+#define SYNC_RUN_MAX 16
+
+/* Number of pages read ahead of a fault in a region advised to be
+   accessed sequentially.  Pages twice as far behind the fault are
+   freed. */
+#define READ_AHEAD_PAGES 16
+
+/* Maximum number of swap reads that prefetching keeps in flight. */
+#define PREFETCH_BATCH 16
+
+/* Number of pages released together when a process exits. */
+#define TEARDOWN_BATCH 64
+
+/* Default number of pages in the window mapped around a fault on
+   a file-backed page. */
+#define FAULT_AROUND_DEFAULT 8
+
+/* Number of pages in the window mapped around a fault on a
+   file-backed page, set by the "-fault-around" kernel option.  0
+   or 1 disables fault-around. */
+size_t fault_around_pages = FAULT_AROUND_DEFAULT;
+
+static bool read_page (struct page *, void *kpage);
+static bool map_loaded_page (struct page *, void *kpage,
+                             const struct frame_key *);
+static bool swap_in_around (struct page *, void *kpage, bool around);
+static void map_swapped_in (struct page **, size_t cnt);
+static int page_advice (struct page *);
+static void advise_fault (struct page *, int advice, bool shareable);
+static void fault_around (struct page *);
+static void prefetch (uint8_t *start, uint8_t *end);
+static bool prefetch_page (struct page *);
+static void discard_page (struct page *, bool discard_dirty);
+static void sync_run (struct page **, size_t cnt);
+static bool page_key (const struct page *, struct frame_key *);
+
+/* Initializes the shared zero page and the cache of struct
+   page. */
 void
 page_init (void)
 {
-  lock_init (&sup_page_table_lock);
-  hash_init (&sup_page_table, hash_func, hash_less, NULL);
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  spt_cache = kmem_cache_create ("page", sizeof (struct page), NULL);
 }
 
-/* Lazy allocates a page, but do not insert it into page directory. */
-bool
-page_lazy_load (struct file *file, off_t ofs, void *upage, uint32_t read_bytes,
-                uint32_t zero_bytes, bool writable, enum page_type type)
+/* Frees the current process's supplemental page table and every
+   page left in it, in a single walk, along with its remaining
+   regions.  Pages are released in batches of TEARDOWN_BATCH,
+   taking each lock involved once per batch, and swapped-out
+   pages just have their slots freed, without any I/O.
+
+   Page table entries are not cleared, so this must be followed
+   by destroying the process's page directory. */
+void
+page_table_destroy (void)
 {
-  struct page *page = malloc (sizeof (struct page));
-  if (page == NULL)
-    return false;
+  struct page *batch[TEARDOWN_BATCH];
+  size_t batch_cnt = 0;
+  struct thread *t = thread_current ();
 
-  ASSERT (pg_round_down (upage) == upage);
+  lock_acquire (&t->page_lock);
+  page_table_t **pd = (page_table_t **)t->pages;
+  t->pages = NULL;
+  while (!list_empty (&t->regions))
+    free (list_entry (list_pop_front (&t->regions), struct region, elem));
+  lock_release (&t->page_lock);
+  if (pd == NULL)
+    return;
+
+  for (size_t pde = 0; pde < pd_no (PHYS_BASE); pde++)
+    if (pd[pde] != NULL)
+      {
+        for (size_t pte = 0; pte < PGSIZE / sizeof (struct page *); pte++)
+          {
+            struct page *page = (*pd[pde])[pte];
+            if (page != NULL)
+              {
+                batch[batch_cnt++] = page;
+                if (batch_cnt == TEARDOWN_BATCH)
+                  {
+                    release_pages (batch, batch_cnt);
+                    batch_cnt = 0;
+                  }
+              }
+          }
+        palloc_free_page (pd[pde]);
+      }
+  release_pages (batch, batch_cnt);
+  palloc_free_page (pd);
+}
+
+/* Maps READ_BYTES + ZERO_BYTES bytes of the current process's
+   address space, starting at UPAGE, as a region whose pages are
+   loaded on demand as pages of type TYPE.  The first READ_BYTES
+   bytes come from FILE starting at offset OFS and the rest are
+   zeroed.  No struct page is created until a page first faults.
+
+   Returns the new region, or a null pointer if the range is not
+   in user space below the stack, overlaps another region, or
+   memory is short. */
+struct region *
+page_map (struct file *file, off_t ofs, void *upage, uint32_t read_bytes,
+          uint32_t zero_bytes, bool writable, enum page_type type)
+{
+  struct thread *t = thread_current ();
+  uint8_t *start = upage;
+  uint8_t *end = start + read_bytes + zero_bytes;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
+  ASSERT (type == PAGE_UNALLOC || type == PAGE_FILE);
+
+  if (start == NULL || end <= start
+      || end > (uint8_t *)PHYS_BASE - STACK_SIZE_MAX)
+    return NULL;
+
+  struct region *r = malloc (sizeof *r);
+  if (r == NULL)
+    return NULL;
+  r->start = start;
+  r->end = end;
+  r->type = type;
+  r->file = file;
+  r->ofs = ofs;
+  r->read_bytes = read_bytes;
+  r->writable = writable;
+  r->advice = MADV_NORMAL;
+
+  /* Regions are sorted by address, so the first one that ends
+     after START is the only one that might overlap. */
+  lock_acquire (&t->page_lock);
+  struct list_elem *e;
+  for (e = list_begin (&t->regions); e != list_end (&t->regions);
+       e = list_next (e))
+    if (list_entry (e, struct region, elem)->end > r->start)
+      break;
+  if (e != list_end (&t->regions)
+      && list_entry (e, struct region, elem)->start < r->end)
+    {
+      lock_release (&t->page_lock);
+      free (r);
+      return NULL;
+    }
+  list_insert (e, &r->elem);
+  lock_release (&t->page_lock);
+  return r;
+}
+
+/* Unmaps region R from the current process and frees it along
+   with any of its pages that have been created.  Does not write
+   back modified pages; call page_sync() first for that. */
+void
+page_unmap (struct region *r)
+{
+  struct thread *t = thread_current ();
+
+  lock_acquire (&t->page_lock);
+  list_remove (&r->elem);
+  lock_release (&t->page_lock);
+
+  for (uint8_t *upage = r->start; upage < r->end; upage += PGSIZE)
+    page_free (get_page (upage, t));
+  free (r);
+}
+
+/* Writes the modified pages of file-mapped region R, which must
+   belong to the current process, back to the file.  Only pages
+   that are resident and dirty, through any mapping of their
+   frame, are written, in file order, with runs of adjacent pages
+   combined into single writes.  Pages that are not resident were
+   written back when they were evicted, so they need no I/O. */
+void
+page_sync (struct region *r)
+{
+  struct thread *t = thread_current ();
+  struct page *run[SYNC_RUN_MAX];
+  size_t cnt = 0;
+
+  if (r->type != PAGE_FILE)
+    return;
+
+  for (uint8_t *upage = r->start; upage < r->end; upage += PGSIZE)
+    {
+      struct page *page = get_page (upage, t);
+      bool dirty = false;
+      if (page != NULL && frame_pin_resident (page))
+        {
+          /* Keep it resident until it has been written.  Another
+             process sharing the frame may have modified it. */
+          dirty = frame_clear_dirty (page->kpage);
+          if (!dirty)
+            frame_set_pinned (page->kpage, false);
+        }
+
+      if (!dirty)
+        {
+          sync_run (run, cnt);
+          cnt = 0;
+          continue;
+        }
+      run[cnt++] = page;
+      if (cnt == SYNC_RUN_MAX || page->read_bytes < PGSIZE)
+        {
+          sync_run (run, cnt);
+          cnt = 0;
+        }
+    }
+  sync_run (run, cnt);
+}
+
+/* Writes the CNT pinned, adjacent pages in RUN back to their file
+   with a single write, through their user addresses, and unpins
+   them. */
+static void
+sync_run (struct page **run, size_t cnt)
+{
+  if (cnt == 0)
+    return;
+
+  off_t bytes = 0;
+  for (size_t i = 0; i < cnt; i++)
+    bytes += run[i]->read_bytes;
+  file_write_at (run[0]->file, run[0]->upage, bytes, run[0]->ofs);
+  for (size_t i = 0; i < cnt; i++)
+    frame_set_pinned (run[i]->kpage, false);
+}
+
+/* Returns the region of T that contains UPAGE, or a null pointer
+   if there is none.  T's page_lock must be held. */
+static struct region *
+find_region (struct thread *t, const uint8_t *upage)
+{
+  ASSERT (lock_held_by_current_thread (&t->page_lock));
+
+  struct list_elem *e;
+  for (e = list_begin (&t->regions); e != list_end (&t->regions);
+       e = list_next (e))
+    {
+      struct region *r = list_entry (e, struct region, elem);
+      if (r->end > upage)
+        return r->start <= upage ? r : NULL;
+    }
+  return NULL;
+}
+
+/* Creates the page at UPAGE in T's region that contains it, if
+   any, adds it to T's supplemental page table, and returns it.
+   Returns a null pointer if UPAGE isn't in a region or memory is
+   short.  T's page_lock must be held and UPAGE must not have a
+   page yet. */
+static struct page *
+create_page (struct thread *t, uint8_t *upage)
+{
+  ASSERT (lock_held_by_current_thread (&t->page_lock));
+
+  struct region *r = find_region (t, upage);
+  if (r == NULL)
+    return NULL;
 
-  lock_acquire (&sup_page_table_lock);
+  struct page **entry = lookup_entry (t, upage, true);
+  if (entry == NULL)
+    return NULL;
+  ASSERT (*entry == NULL);
+  struct page *page = kmem_cache_alloc (spt_cache);
+  if (page == NULL)
+    return NULL;
 
-  page->type = type;
+  size_t page_ofs = upage - r->start;
+  page->type = r->type;
   page->kpage = NULL;
   page->slot_idx = SLOT_ERR;
+  page->zero_mapped = false;
 
-  page->file = file;
-  page->ofs = ofs;
+  page->file = r->file;
+  page->ofs = r->ofs + page_ofs;
   page->upage = upage;
-  page->read_bytes = read_bytes;
-  page->zero_bytes = zero_bytes;
-  page->writable = writable;
-
-  page->owner = thread_current ();
+  page->read_bytes = (r->read_bytes <= page_ofs ? 0
+                      : r->read_bytes - page_ofs < PGSIZE
+                          ? r->read_bytes - page_ofs
+                          : PGSIZE);
+  page->zero_bytes = PGSIZE - page->read_bytes;
+  page->writable = r->writable;
 
-  hash_insert (&sup_page_table, &page->hashelem);
-  if (type == PAGE_UNALLOC)
-    list_push_back (&page->owner->page_list, &page->listelem);
-  lock_release (&sup_page_table_lock);
-  return true;
+  page->owner = t;
+  *entry = page;
+  return page;
 }
 
-/* Converts a fault address to a page. */
+/* Converts a fault address to a page.  Returns a null pointer if
+   the page hasn't been created, even if it is in a region. */
 struct page *
-get_page (const void *fault_addr, const struct thread *t)
+get_page (const void *fault_addr, struct thread *t)
 {
-  struct page tmp;
-  tmp.upage = pg_round_down (fault_addr);
-  tmp.owner = (struct thread *)t;
-  lock_acquire (&sup_page_table_lock);
-  struct hash_elem *e = hash_find (&sup_page_table, &tmp.hashelem);
-  lock_release (&sup_page_table_lock);
-  return e != NULL ? hash_entry (e, struct page, hashelem) : NULL;
+  if (!is_user_vaddr (fault_addr))
+    return NULL;
+
+  lock_acquire (&t->page_lock);
+  struct page **entry = lookup_entry (t, fault_addr, false);
+  struct page *page = entry != NULL ? *entry : NULL;
+  lock_release (&t->page_lock);
+  return page;
 }
 
-/* Fully loads the page and inserts it into the page directory. */
+/* Fully loads the page and inserts it into the page directory.
+   WRITE is true if the fault was caused by a write; a page of
+   zeros that is only read is mapped to the shared zero page
+   instead of getting a frame of its own. */
 bool
-page_full_load (void *fault_addr)
+page_full_load (void *fault_addr, bool write)
 {
   if (fault_addr == NULL)
     return false;
 
-  struct page *page = get_page (fault_addr, thread_current ());
+  struct thread *t = thread_current ();
+  struct page *page = get_page (fault_addr, t);
   void *kpage = NULL;
+  struct frame_key key;
+  bool shareable = false;
+  if (page == NULL && is_user_vaddr (fault_addr))
+    {
+      /* First touch of a page in a region. */
+      lock_acquire (&t->page_lock);
+      page = create_page (t, pg_round_down (fault_addr));
+      lock_release (&t->page_lock);
+    }
   if (page == NULL)
     goto fail;
   ASSERT (page->owner == thread_current ());
+  int advice = page_advice (page);
+
+  /* The page may have faulted because it is being evicted.  Let
+     the write-back finish before reading it in again. */
+  frame_wait_evicted (page);
+
+  if (page->type == PAGE_UNALLOC && page->read_bytes == 0 && !write)
+    return map_zero_page (page);
 
   if (page->type == PAGE_UNALLOC || page->type == PAGE_FILE)
     {
@@ -94,45 +386,20 @@ page_full_load (void *fault_addr)
       ASSERT (page->slot_idx == SLOT_ERR);
 
       /* Try to find a existing frame to share. */
-      lock_acquire (&sup_page_table_lock);
-      if (page->type == PAGE_UNALLOC && page->file != NULL
-          && page->writable == false)
+      shareable = page_key (page, &key);
+      if (shareable && frame_share_cached (&key, page, true))
         {
-          struct hash_iterator it;
-          hash_first (&it, &sup_page_table);
-          while (hash_next (&it))
-            {
-              struct page *cur
-                  = hash_entry (hash_cur (&it), struct page, hashelem);
-              if (strcmp (page->owner->name, cur->owner->name) == 0
-                  && page->ofs == cur->ofs && cur->type == PAGE_ALLOC
-                  && cur->writable == false)
-                {
-                  ASSERT (cur->kpage != NULL);
-                  ASSERT (cur->slot_idx == SLOT_ERR);
-
-                  frame_share (cur->kpage, page->upage, page);
-                  kpage = cur->kpage;
-                  lock_release (&sup_page_table_lock);
-                  goto end;
-                }
-            }
+          if (page->type == PAGE_UNALLOC)
+            page->type = PAGE_ALLOC;
+          advise_fault (page, advice, shareable);
+          return true;
         }
-      lock_release (&sup_page_table_lock);
 
       kpage = frame_alloc (PAL_USER, page->upage, page, true);
       if (kpage == NULL)
         goto fail;
-
-      if (page->read_bytes != 0)
-        {
-          file_seek (page->file, page->ofs);
-          off_t read = file_read (page->file, kpage, page->read_bytes);
-          if (read != (off_t)page->read_bytes)
-            goto fail;
-        }
-
-      memset (kpage + page->read_bytes, 0, page->zero_bytes);
+      if (!read_page (page, kpage))
+        goto fail;
     }
   else if (page->type == PAGE_ALLOC)
     {
@@ -142,15 +409,48 @@ page_full_load (void *fault_addr)
       if (kpage == NULL)
         goto fail;
 
-      if (!swap_in (page->slot_idx, kpage))
+      if (!swap_in_around (page, kpage, advice != MADV_RANDOM))
         goto fail;
     }
 
-end:
   if (pg_ofs (page->upage) != 0)
     printf ("page_full_load: page->upage is not page aligned\n");
-  if (!pagedir_install_page (page->owner, page->upage, kpage, page->writable))
+  if (!map_loaded_page (page, kpage, shareable ? &key : NULL))
     goto fail;
+  advise_fault (page, advice, shareable);
+  return true;
+
+fail:
+  if (kpage != NULL)
+    frame_free (kpage);
+  return false;
+}
+
+/* Reads the contents of file-backed or zero PAGE into KPAGE.
+   Returns true if successful. */
+static bool
+read_page (struct page *page, void *kpage)
+{
+  if (page->read_bytes != 0)
+    {
+      off_t read = file_read_at (page->file, kpage, page->read_bytes,
+                                 page->ofs);
+      if (read != (off_t)page->read_bytes)
+        return false;
+    }
+  memset (kpage + page->read_bytes, 0, page->zero_bytes);
+  return true;
+}
+
+/* Maps PAGE to KPAGE, a pinned frame that holds its contents, and
+   unpins it.  If KEY is nonnull, also enters the frame in the
+   page cache under KEY.  Returns false if the mapping could not
+   be made, leaving the frame to the caller. */
+static bool
+map_loaded_page (struct page *page, void *kpage, const struct frame_key *key)
+{
+  if (!pagedir_install_page (page->owner, page->upage, kpage, page->writable))
+    return false;
   ASSERT (pagedir_get_page (page->owner->pagedir, page->upage) == kpage);
   /* Remember to recover the dirty bit. */
   if (page->type == PAGE_ALLOC)
@@ -159,13 +459,415 @@ end:
   page->kpage = kpage;
   if (page->type == PAGE_UNALLOC)
     page->type = PAGE_ALLOC;
+  if (key != NULL)
+    frame_cache (kpage, key);
   frame_set_pinned (kpage, false);
   return true;
+}
 
-fail:
-  if (kpage != NULL)
+/* Reads swapped-out PAGE into KPAGE.  If AROUND is true, also
+   reads in, in the same batch of requests, the owner's other pages
+   that were swapped out in the same cluster, as long as there are
+   free frames for them, and maps them too.  Returns true if PAGE
+   itself was read. */
+static bool
+swap_in_around (struct page *page, void *kpage, bool around)
+{
+  struct thread *t = page->owner;
+  slot_id slots[READ_AROUND_MAX];
+  void *upages[READ_AROUND_MAX];
+  struct page *extra[READ_AROUND_MAX];
+  size_t extra_cnt = 0;
+
+  /* Claim frames for the neighbours first, so that all the reads
+     are queued together and can be merged. */
+  size_t cnt = (around ? swap_cluster (page->slot_idx, t->tid, slots,
+                                      upages, READ_AROUND_MAX)
+                        : 0);
+  for (size_t i = 0; i < cnt; i++)
+    {
+      struct page *p = get_page (upages[i], t);
+      if (p == NULL || p->type != PAGE_ALLOC || p->kpage != NULL
+          || p->slot_idx != slots[i])
+        continue;
+      void *k = frame_try_alloc (PAL_USER, p->upage, p, true);
+      if (k == NULL)
+        break;
+      p->kpage = k;
+      if (!swap_read (p->slot_idx, k, frame_request (k)))
+        {
+          frame_remove (p);
+          p->kpage = NULL;
+          continue;
+        }
+      extra[extra_cnt++] = p;
+    }
+
+  struct block_request request;
+  bool success = swap_read (page->slot_idx, kpage, &request);
+  if (success)
+    {
+      block_wait (&request);
+      swap_free (page->slot_idx);
+      page->slot_idx = SLOT_ERR;
+    }
+
+  /* Map the neighbours speculatively.  They are left unaccessed,
+     so the clock evicts them first if they turn out not to be
+     needed, and clean, so that doing so costs no write. */
+  map_swapped_in (extra, extra_cnt);
+  return success;
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the LEN bytes of
+   the current process's address space starting at page-aligned
+   ADDR.  Access pattern advice is remembered for each whole region
+   the range overlaps.  A LEN of 0 does nothing and succeeds.
+   Returns false if ADDR, LEN, or ADVICE is invalid. */
+bool
+page_advise (void *addr, size_t len, int advice)
+{
+  struct thread *t = thread_current ();
+  uint8_t *start = addr;
+  uint8_t *end = start + ROUND_UP (len, PGSIZE);
+
+  if (start == NULL || pg_ofs (start) != 0 || (len != 0 && end <= start)
+      || end > (uint8_t *)PHYS_BASE)
+    return false;
+
+  switch (advice)
+    {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+      lock_acquire (&t->page_lock);
+      for (struct list_elem *e = list_begin (&t->regions);
+           e != list_end (&t->regions); e = list_next (e))
+        {
+          struct region *r = list_entry (e, struct region, elem);
+          if (r->start < end && r->end > start)
+            r->advice = advice;
+        }
+      lock_release (&t->page_lock);
+      return true;
+
+    case MADV_WILLNEED:
+      prefetch (start, end);
+      return true;
+
+    case MADV_DONTNEED:
+      for (uint8_t *upage = start; upage < end; upage += PGSIZE)
+        {
+          struct page *page = get_page (upage, t);
+          if (page != NULL)
+            discard_page (page, true);
+        }
+      return true;
+
+    default:
+      return false;
+    }
+}
+
+/* Returns the access pattern advice for the region that contains
+   PAGE, or MADV_NORMAL if it is not in a region. */
+static int
+page_advice (struct page *page)
+{
+  struct thread *t = page->owner;
+
+  lock_acquire (&t->page_lock);
+  struct region *r = find_region (t, page->upage);
+  int advice = r != NULL ? r->advice : MADV_NORMAL;
+  lock_release (&t->page_lock);
+  return advice;
+}
+
+/* Acts on ADVICE after PAGE has been loaded by a fault.  Pages
+   ahead of a sequential access are read in and those well behind
+   it are freed.  Otherwise, unless access is random, the cached
+   neighbours of a SHAREABLE page are mapped. */
+static void
+advise_fault (struct page *page, int advice, bool shareable)
+{
+  if (advice == MADV_SEQUENTIAL)
+    {
+      struct thread *t = page->owner;
+      uint8_t *upage = page->upage;
+      size_t ahead = READ_AHEAD_PAGES * PGSIZE;
+
+      lock_acquire (&t->page_lock);
+      struct region *r = find_region (t, upage);
+      uint8_t *start = r != NULL ? r->start : upage;
+      uint8_t *end = r != NULL ? r->end : upage + PGSIZE;
+      lock_release (&t->page_lock);
+
+      prefetch (upage + PGSIZE,
+                (size_t)(end - upage) > PGSIZE + ahead
+                    ? upage + PGSIZE + ahead
+                    : end);
+      if ((size_t)(upage - start) > 2 * ahead)
+        for (uint8_t *behind = upage - 2 * ahead; behind < upage - ahead;
+             behind += PGSIZE)
+          {
+            struct page *p = get_page (behind, t);
+            if (p != NULL)
+              discard_page (p, false);
+          }
+    }
+  else if (advice == MADV_NORMAL && shareable)
+    fault_around (page);
+}
+
+/* Reads in and maps the current process's pages from START up to
+   END that are not resident, without blocking on eviction.  Pages
+   in swap are read in batches so that the reads can be merged.
+   Stops early if few frames are free. */
+static void
+prefetch (uint8_t *start, uint8_t *end)
+{
+  struct thread *t = thread_current ();
+  struct page *swapped[PREFETCH_BATCH];
+  size_t cnt = 0;
+
+  for (uint8_t *upage = start; upage < end && is_user_vaddr (upage);
+       upage += PGSIZE)
+    {
+      struct page *p = get_page (upage, t);
+      if (p == NULL)
+        {
+          lock_acquire (&t->page_lock);
+          p = create_page (t, upage);
+          lock_release (&t->page_lock);
+          if (p == NULL)
+            continue;
+        }
+      if (p->kpage != NULL || p->zero_mapped)
+        continue;
+
+      if (p->type != PAGE_ALLOC)
+        {
+          if (!prefetch_page (p))
+            break;
+          continue;
+        }
+
+      void *k = frame_try_alloc (PAL_USER, p->upage, p, true);
+      if (k == NULL)
+        break;
+      p->kpage = k;
+      if (!swap_read (p->slot_idx, k, frame_request (k)))
+        {
+          frame_remove (p);
+          p->kpage = NULL;
+          continue;
+        }
+      swapped[cnt++] = p;
+      if (cnt == PREFETCH_BATCH)
+        {
+          map_swapped_in (swapped, cnt);
+          cnt = 0;
+        }
+    }
+  map_swapped_in (swapped, cnt);
+}
+
+/* Reads file-backed PAGE in and maps it, sharing a cached frame
+   if there is one.  Pages of zeros are left to fault, since that
+   is cheap.  Returns false only if no frame is free. */
+static bool
+prefetch_page (struct page *page)
+{
+  if (page->type == PAGE_UNALLOC && page->read_bytes == 0)
+    return true;
+
+  struct frame_key key;
+  bool shareable = page_key (page, &key);
+  if (shareable && frame_share_cached (&key, page, false))
+    {
+      if (page->type == PAGE_UNALLOC)
+        page->type = PAGE_ALLOC;
+      return true;
+    }
+
+  void *kpage = frame_try_alloc (PAL_USER, page->upage, page, true);
+  if (kpage == NULL)
+    return false;
+  if (!read_page (page, kpage)
+      || !map_loaded_page (page, kpage, shareable ? &key : NULL))
     frame_free (kpage);
-  return false;
+  return true;
+}
+
+/* Drops PAGE's frame or swap slot, so that it will be loaded
+   afresh, from its file or as zeros, if it is touched again.  A
+   dirty anonymous page, or one whose contents are in swap, is
+   dropped, losing its contents, only if DISCARD_DIRTY is true;
+   otherwise just a clean frame is dropped, leaving the contents
+   in swap.  A dirty page of a mapped file is never dropped, since
+   its contents still have to be written back, but it is marked
+   unaccessed so that it is evicted early. */
+static void
+discard_page (struct page *page, bool discard_dirty)
+{
+  uint32_t *pd = page->owner->pagedir;
+
+  if (page->zero_mapped)
+    {
+      pagedir_clear_page (pd, page->upage);
+      page->zero_mapped = false;
+      return;
+    }
+
+  if (frame_pin_resident (page))
+    {
+      if (pagedir_is_dirty (pd, page->upage)
+          && (page->type == PAGE_FILE || !discard_dirty))
+        {
+          pagedir_set_accessed (pd, page->upage, false);
+          frame_set_pinned (page->kpage, false);
+          return;
+        }
+      pagedir_set_accessed (pd, page->upage, false);
+      pagedir_set_dirty (pd, page->upage, false);
+      pagedir_clear_page (pd, page->upage);
+      frame_remove (page);
+      page->kpage = NULL;
+    }
+
+  /* A clean page read in from swap still has its contents there. */
+  if (page->slot_idx != SLOT_ERR)
+    {
+      if (!discard_dirty)
+        return;
+      swap_free (page->slot_idx);
+    }
+
+  page->slot_idx = SLOT_ERR;
+  if (page->type == PAGE_ALLOC)
+    page->type = PAGE_UNALLOC;
+}
+
+/* Maps the pages around file-backed PAGE, in an aligned window
+   of fault_around_pages pages within PAGE's region, that are
+   already in the page cache, so that touching them later does
+   not fault.  Pages that would need I/O are left alone. */
+static void
+fault_around (struct page *page)
+{
+  struct thread *t = page->owner;
+  size_t window = fault_around_pages * PGSIZE;
+  if (window <= PGSIZE)
+    return;
+
+  lock_acquire (&t->page_lock);
+  struct region *r = find_region (t, page->upage);
+  lock_release (&t->page_lock);
+  if (r == NULL)
+    return;
+
+  size_t page_ofs = (uint8_t *)page->upage - r->start;
+  uint8_t *start = r->start + page_ofs / window * window;
+  uint8_t *end = start + window < r->end ? start + window : r->end;
+  for (uint8_t *upage = start; upage < end; upage += PGSIZE)
+    {
+      if (upage == page->upage
+          || pagedir_get_page (t->pagedir, upage) != NULL)
+        continue;
+
+      struct page *p = get_page (upage, t);
+      if (p == NULL)
+        {
+          lock_acquire (&t->page_lock);
+          p = create_page (t, upage);
+          lock_release (&t->page_lock);
+          if (p == NULL)
+            break;
+        }
+      if (p->kpage != NULL || p->zero_mapped
+          || (p->type != PAGE_UNALLOC && p->type != PAGE_FILE))
+        continue;
+
+      struct frame_key key;
+      if (page_key (p, &key) && frame_share_cached (&key, p, false)
+          && p->type == PAGE_UNALLOC)
+        p->type = PAGE_ALLOC;
+    }
+}
+
+/* Waits for the swap reads into the frames of the CNT pages in
+   PAGES, which must be pinned, and maps each page whose read
+   succeeded.  The pages are mapped clean and keep their swap
+   slots, which still hold their contents, until they are
+   modified and evicted. */
+static void
+map_swapped_in (struct page **pages, size_t cnt)
+{
+  for (size_t i = 0; i < cnt; i++)
+    {
+      struct page *p = pages[i];
+      struct thread *t = p->owner;
+      block_wait (frame_request (p->kpage));
+      if (!pagedir_install_page (t, p->upage, p->kpage, p->writable))
+        {
+          /* Leave it in swap. */
+          frame_remove (p);
+          p->kpage = NULL;
+          continue;
+        }
+      frame_set_pinned (p->kpage, false);
+    }
+}
+
+/* Handles a write to the present but read-only user page at
+   FAULT_ADDR.  If the page is a writable one that is mapped to
+   the shared zero page, gives it a zeroed frame of its own and
+   returns true.  Otherwise, the write is not allowed and returns
+   false. */
+bool
+page_write_fault (void *fault_addr)
+{
+  struct thread *t = thread_current ();
+  struct page *page = get_page (fault_addr, t);
+  if (page == NULL || !page->zero_mapped || !page->writable)
+    return false;
+
+  pagedir_clear_page (t->pagedir, page->upage);
+  page->zero_mapped = false;
+  return page_full_load (fault_addr, true);
+}
+
+/* Maps PAGE, which must be all zeros and not yet loaded, to the
+   shared zero page, read-only. */
+static bool
+map_zero_page (struct page *page)
+{
+  ASSERT (page->type == PAGE_UNALLOC && page->read_bytes == 0);
+  ASSERT (page->kpage == NULL && !page->zero_mapped);
+
+  if (!pagedir_install_page (page->owner, page->upage, zero_page, false))
+    return false;
+  page->zero_mapped = true;
+  return true;
+}
+
+/* If other processes may share a frame holding PAGE's contents,
+   stores the page cache key for them into KEY and returns true.
+   Those are read-only pages of an executable and pages of a
+   mapped file, which are found by file and offset. */
+static bool
+page_key (const struct page *page, struct frame_key *key)
+{
+  if (page->file == NULL
+      || (page->type == PAGE_UNALLOC && page->writable))
+    return false;
+  ASSERT (page->type == PAGE_UNALLOC || page->type == PAGE_FILE);
+
+  key->inumber = inode_get_inumber (file_get_inode (page->file));
+  key->ofs = page->ofs;
+  key->read_bytes = page->read_bytes;
+  key->mmap = page->type == PAGE_FILE;
+  return true;
 }
 
 void
@@ -174,54 +876,83 @@ page_free (struct page *page)
   if (page == NULL)
     return;
 
-  if (page->kpage != NULL)
-    frame_set_pinned (page->kpage, true);
+  remove_page (page);
+  release_page (page);
+  kmem_cache_free (spt_cache, page);
+}
+
+/* Releases the frame or swap slot that holds PAGE, if any. */
+static void
+release_page (struct page *page)
+{
+  if (page->zero_mapped)
+    {
+      pagedir_clear_page (page->owner->pagedir, page->upage);
+      page->zero_mapped = false;
+    }
+
+  bool resident = frame_pin_resident (page);
 
   if (page->type == PAGE_ALLOC || page->type == PAGE_FILE)
     {
-      if (page->kpage != NULL)
+      if (resident)
         {
-          frame_remove (page);
-          page->kpage = NULL;
           pagedir_set_accessed (page->owner->pagedir, page->upage, false);
           pagedir_set_dirty (page->owner->pagedir, page->upage, false);
           pagedir_clear_page (page->owner->pagedir, page->upage);
+          frame_remove (page);
+          page->kpage = NULL;
+          resident = false;
         }
-      else
+      if (page->slot_idx != SLOT_ERR)
         {
-          ASSERT (page->slot_idx != SLOT_ERR);
-          void *tmp = palloc_get_page (0);
-          /* XXX: will we fail to allocate memory from the kernel pool? */
-          ASSERT (tmp != NULL);
-          ASSERT (swap_in (page->slot_idx, tmp));
-          palloc_free_page (tmp);
+          /* Its contents are no longer needed, so don't read them. */
+          swap_free (page->slot_idx);
+          page->slot_idx = SLOT_ERR;
         }
     }
 
-  if (page->kpage != NULL)
+  if (resident)
     frame_set_pinned (page->kpage, false);
+}
+
+/* Releases the CNT pages in BATCH, which belong to the current
+   process as it exits, and frees them: their frames go back to
+   the frame table under one acquisition of its lock, their swap
+   slots are freed together, and the pages go back to their
+   cache. */
+static void
+release_pages (struct page **batch, size_t cnt)
+{
+  slot_id slots[TEARDOWN_BATCH];
+  size_t slot_cnt = 0;
 
-  if (page->type != PAGE_FILE)
-    list_remove (&page->listelem);
-  lock_acquire (&sup_page_table_lock);
-  hash_delete (&sup_page_table, &page->hashelem);
-  lock_release (&sup_page_table_lock);
-  free (page);
+  ASSERT (cnt <= TEARDOWN_BATCH);
+  frame_release_pages (batch, cnt);
+  for (size_t i = 0; i < cnt; i++)
+    {
+      struct page *page = batch[i];
+      if ((page->type == PAGE_ALLOC || page->type == PAGE_FILE)
+          && page->slot_idx != SLOT_ERR)
+        slots[slot_cnt++] = page->slot_idx;
+    }
+  swap_free_many (slots, slot_cnt);
+  kmem_cache_free_many (spt_cache, (void **)batch, cnt);
 }
 
 /* Fully loads a stack page and inserts it into the page directory.
-   It will be initialized as an anonymous page and zeroed. */
+   It will be initialized as an anonymous page and zeroed, or mapped
+   to the shared zero page if WRITE is false. */
 bool
-page_full_load_stack (void *upage)
+page_full_load_stack (void *upage, bool write)
 {
-  struct page *page = malloc (sizeof (struct page));
+  struct page *page = kmem_cache_alloc (spt_cache);
   void *kpage = NULL;
   if (page == NULL)
     return false;
 
   ASSERT (pg_round_down (upage) == upage);
 
-  lock_acquire (&sup_page_table_lock);
   page->type = PAGE_UNALLOC;
   page->kpage = NULL;
   page->slot_idx = SLOT_ERR;
@@ -232,11 +963,20 @@ page_full_load_stack (void *upage)
   page->read_bytes = 0;
   page->zero_bytes = PGSIZE;
   page->writable = true;
+  page->zero_mapped = false;
 
   page->owner = thread_current ();
-  hash_insert (&sup_page_table, &page->hashelem);
-  list_push_back (&page->owner->page_list, &page->listelem);
-  lock_release (&sup_page_table_lock);
+  if (!insert_page (page))
+    {
+      kmem_cache_free (spt_cache, page);
+      return false;
+    }
+  if (!write)
+    {
+      if (!map_zero_page (page))
+        goto fail;
+      return true;
+    }
 
   kpage = frame_alloc (PAL_USER | PAL_ZERO, upage, page, true);
   if (kpage == NULL)
@@ -251,30 +991,73 @@ page_full_load_stack (void *upage)
   frame_set_pinned (kpage, false);
   return true;
 fail:
-  free (page);
+  remove_page (page);
+  kmem_cache_free (spt_cache, page);
   if (kpage != NULL)
     frame_free (kpage);
   return false;
 }
 
-static unsigned
-hash_func (const struct hash_elem *elem, void *aux UNUSED)
+/* Returns the address of the entry for UPAGE in T's supplemental
+   page table.  If the table that would hold it doesn't exist,
+   allocates it if CREATE is true, or returns a null pointer
+   otherwise or if allocation fails.  T's page_lock must be
+   held. */
+static struct page **
+lookup_entry (struct thread *t, const void *upage, bool create)
 {
-  const struct page *page = hash_entry (elem, struct page, hashelem);
-  unsigned h1 = hash_bytes (&page->upage, sizeof (page->upage));
-  unsigned h2 = hash_int (page->owner == NULL ? TID_ERROR : page->owner->tid);
-  return h1 ^ h2;
+  ASSERT (lock_held_by_current_thread (&t->page_lock));
+  ASSERT (is_user_vaddr (upage));
+
+  page_table_t **pd = (page_table_t **)t->pages;
+  if (pd == NULL)
+    {
+      if (!create)
+        return NULL;
+      pd = palloc_get_page (PAL_ZERO);
+      if (pd == NULL)
+        return NULL;
+      t->pages = (struct page ***)pd;
+    }
+
+  page_table_t **pde = &pd[pd_no (upage)];
+  if (*pde == NULL)
+    {
+      if (!create)
+        return NULL;
+      *pde = palloc_get_page (PAL_ZERO);
+      if (*pde == NULL)
+        return NULL;
+    }
+  return &(**pde)[pt_no (upage)];
 }
 
+/* Adds PAGE to its owner's supplemental page table.  Returns
+   false if memory is short or there is a page at its address
+   already. */
 static bool
-hash_less (const struct hash_elem *lhs, const struct hash_elem *rhs,
-           void *aux UNUSED)
+insert_page (struct page *page)
 {
-  const struct page *lhs_ = hash_entry (lhs, struct page, hashelem);
-  const struct page *rhs_ = hash_entry (rhs, struct page, hashelem);
-  uintptr_t l_upage = (uintptr_t)lhs_->upage;
-  tid_t l_tid = lhs_->owner == NULL ? TID_ERROR : lhs_->owner->tid;
-  uintptr_t r_upage = (uintptr_t)rhs_->upage;
-  tid_t r_tid = rhs_->owner == NULL ? TID_ERROR : rhs_->owner->tid;
-  return l_upage < r_upage || (l_upage == r_upage && l_tid < r_tid);
+  struct thread *t = page->owner;
+
+  lock_acquire (&t->page_lock);
+  struct page **entry = lookup_entry (t, page->upage, true);
+  bool success = entry != NULL && *entry == NULL;
+  if (success)
+    *entry = page;
+  lock_release (&t->page_lock);
+  return success;
+}
+
+/* Removes PAGE from its owner's supplemental page table. */
+static void
+remove_page (struct page *page)
+{
+  struct thread *t = page->owner;
+
+  lock_acquire (&t->page_lock);
+  struct page **entry = lookup_entry (t, page->upage, false);
+  ASSERT (entry != NULL && *entry == page);
+  *entry = NULL;
+  lock_release (&t->page_lock);
 }
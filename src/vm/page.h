@@ -4,7 +4,6 @@
 #include "filesys/file.h"
 #include "threads/thread.h"
 #include "vm/swap.h"
-#include <hash.h>
 
 #define STACK_SIZE_MAX 0x800000 /* Maximum user stack size. */
 
@@ -21,7 +20,9 @@ enum page_type
    A page can be one of difference types:
    - UNALLOC: unallocated anonymous page. it will be allocated when accessed.
    - ALLOC: allocated anonymous page. it is not backed by any file. it might be
-     in the swap slot if evicted.
+     in the swap slot if evicted.  A page read in from swap ahead of use
+     keeps its slot until it is modified, so it can be evicted again
+     without being written.
    - FILE: file backed page. it might be in the filesys if evicted or unloaded.
  */
 struct page
@@ -29,6 +30,7 @@ struct page
   enum page_type type; /* Page type. */
   void *kpage;         /* Frame mapped to this page, if it exists. */
   slot_id slot_idx;    /* Slot store this page, if it exists. */
+  bool zero_mapped;    /* Mapped read-only to the shared zero page? */
 
   /* We need some metadata to load the correct data from file. */
   struct file *file;
@@ -38,18 +40,41 @@ struct page
   uint32_t zero_bytes;
   bool writable;
 
-  struct hash_elem hashelem; /* Used by sup_hash_table. */
-  struct list_elem listelem; /* Used by page_list in struct thread. */
-  struct thread *owner;      /* The thread that own this page. */
+  struct thread *owner; /* The thread that own this page. */
 };
 
+/* A range of a process's address space whose pages are loaded on
+   demand: an ELF segment, with pages of type PAGE_UNALLOC, or a
+   mapped file, with pages of type PAGE_FILE.  The struct page for
+   each page is created when it first faults.  The regions of a
+   process are kept in its REGIONS list, sorted by address. */
+struct region
+{
+  uint8_t *start;        /* First page. */
+  uint8_t *end;          /* One past the last page. */
+  enum page_type type;   /* Type of the pages. */
+  struct file *file;     /* File the pages are loaded from. */
+  off_t ofs;             /* Offset in FILE of START. */
+  uint32_t read_bytes;   /* Bytes read from FILE; the rest are zeros. */
+  bool writable;         /* Whether the pages are writable. */
+  int advice;            /* Access pattern, one of the MADV_* values. */
+  struct list_elem elem; /* Element in the owner's REGIONS. */
+};
+
+extern size_t fault_around_pages;
+
 void page_init (void);
-bool page_lazy_load (struct file *file, off_t ofs, void *upage,
-                     uint32_t read_bytes, uint32_t zero_bytes, bool writable,
-                     enum page_type);
-bool page_full_load (void *fault_addr);
-bool page_full_load_stack (void *upage);
+void page_table_destroy (void);
+struct region *page_map (struct file *file, off_t ofs, void *upage,
+                         uint32_t read_bytes, uint32_t zero_bytes,
+                         bool writable, enum page_type);
+void page_unmap (struct region *);
+void page_sync (struct region *);
+bool page_advise (void *addr, size_t len, int advice);
+bool page_full_load (void *fault_addr, bool write);
+bool page_full_load_stack (void *upage, bool write);
+bool page_write_fault (void *fault_addr);
 void page_free (struct page *);
-struct page *get_page (const void *fault_addr, const struct thread *t);
+struct page *get_page (const void *fault_addr, struct thread *t);
 
 #endif /* vm/page.h */
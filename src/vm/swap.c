@@ -1,7 +1,9 @@
 #include "vm/swap.h"
 #include "devices/block.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "vm/zswap.h"
 #include <bitmap.h>
 #include <debug.h>
 
@@ -14,8 +16,18 @@ static struct bitmap *swap_bitmap;
 /* Use a lock to protect the swap bitmap. */
 static struct lock swap_lock;
 
-/* The number of sectors a slot occupies. */
-#define SLOT_SIZE (PGSIZE / BLOCK_SECTOR_SIZE)
+/* What an allocated slot holds.  Slots allocated together form a
+   cluster, normally pages evicted at the same time, and a fault on
+   one of them reads in the others that belong to the same process
+   as well.  Protected by swap_lock. */
+struct slot_info
+{
+  tid_t owner;        /* Process that swapped the page out. */
+  void *upage;        /* User virtual address of the page. */
+  slot_id cluster;    /* First slot of the cluster. */
+  size_t cluster_cnt; /* Number of slots in the cluster. */
+};
+static struct slot_info *slot_info;
 
 /* Initializes the swap table. */
 void
@@ -25,29 +37,118 @@ swap_init (void)
   if (swap_device == NULL)
     PANIC ("The swap partition is unavailable, can't initialize swap table.");
 
-  swap_bitmap = bitmap_create (block_size (swap_device) / SLOT_SIZE);
-  if (swap_bitmap == NULL)
+  size_t slot_cnt = block_size (swap_device) / SLOT_SIZE;
+  swap_bitmap = bitmap_create (slot_cnt);
+  slot_info = calloc (slot_cnt, sizeof *slot_info);
+  if (swap_bitmap == NULL || slot_info == NULL)
     PANIC ("Swap bitmap creation failed.");
   bitmap_set_all (swap_bitmap, false);
 
   lock_init (&swap_lock);
+  zswap_init (swap_device, slot_cnt);
 }
 
-/* If the swap partition is not full, try to allocate a swap slot and return
-   its index. Otherwise, return SLOT_ERR. */
+/* Allocates CNT consecutive swap slots, as one cluster, and
+   returns the index of the first one, or SLOT_ERR if the swap
+   partition has no run of CNT free slots. */
 slot_id
-swap_out (const void *kpage)
+swap_alloc (size_t cnt)
+{
+  lock_acquire (&swap_lock);
+  slot_id ret = bitmap_scan_and_flip (swap_bitmap, 0, cnt, false);
+  if (ret != BITMAP_ERROR)
+    for (size_t i = 0; i < cnt; i++)
+      {
+        slot_info[ret + i].owner = TID_ERROR;
+        slot_info[ret + i].upage = NULL;
+        slot_info[ret + i].cluster = ret;
+        slot_info[ret + i].cluster_cnt = cnt;
+      }
+  lock_release (&swap_lock);
+  return ret == BITMAP_ERROR ? SLOT_ERR : ret;
+}
+
+/* Frees slot SLOT_IDX. */
+void
+swap_free (slot_id slot_idx)
+{
+  zswap_invalidate (slot_idx);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_bitmap, slot_idx));
+  bitmap_reset (swap_bitmap, slot_idx);
+  lock_release (&swap_lock);
+}
+
+/* Frees the CNT slots in SLOTS, taking swap_lock only once.
+   Their contents are discarded without being read. */
+void
+swap_free_many (const slot_id *slots, size_t cnt)
+{
+  for (size_t i = 0; i < cnt; i++)
+    zswap_invalidate (slots[i]);
+
+  lock_acquire (&swap_lock);
+  for (size_t i = 0; i < cnt; i++)
+    {
+      ASSERT (bitmap_test (swap_bitmap, slots[i]));
+      bitmap_reset (swap_bitmap, slots[i]);
+    }
+  lock_release (&swap_lock);
+}
+
+/* Starts writing the page at KPAGE, which process OWNER maps at
+   UPAGE, to slot SLOT_IDX, which must have been allocated with
+   swap_alloc(), using REQUEST, and returns without waiting.
+   COMPLETE is called with REQUEST, whose aux member is AUX, once
+   the page is on disk.
+
+   If the compressed pool takes the page, COMPLETE is called
+   before returning.  Otherwise, writes to adjacent slots
+   submitted together are merged by the disk driver into a single
+   transfer. */
+void
+swap_write (slot_id slot_idx, const void *kpage, tid_t owner, void *upage,
+            struct block_request *request, block_complete_func *complete,
+            void *aux)
 {
+  ASSERT (slot_idx < bitmap_size (swap_bitmap));
+
   lock_acquire (&swap_lock);
-  slot_id ret = bitmap_scan_and_flip (swap_bitmap, 0, 1, false);
+  slot_info[slot_idx].owner = owner;
+  slot_info[slot_idx].upage = upage;
   lock_release (&swap_lock);
-  if (ret == BITMAP_ERROR)
-    return SLOT_ERR;
 
-  for (int i = 0; i < SLOT_SIZE; i++)
-    block_write (swap_device, ret * SLOT_SIZE + i,
-                 kpage + i * BLOCK_SECTOR_SIZE);
-  return ret;
+  block_request_init (request, swap_device, slot_idx * SLOT_SIZE, SLOT_SIZE,
+                      (void *)kpage, true, complete, aux);
+  if (!zswap_store (slot_idx, kpage))
+    block_submit (request);
+  else if (complete != NULL)
+    complete (request);
+  else
+    sema_up (&request->done);
+}
+
+/* If the slot is valid, starts reading it into KPAGE using REQUEST
+   and returns true; the caller must then block_wait() on REQUEST
+   and free the slot with swap_free().  Otherwise, returns false. */
+bool
+swap_read (slot_id slot_idx, void *kpage, struct block_request *request)
+{
+  lock_acquire (&swap_lock);
+  bool valid = (slot_idx < bitmap_size (swap_bitmap)
+                && bitmap_test (swap_bitmap, slot_idx));
+  lock_release (&swap_lock);
+  if (!valid)
+    return false;
+
+  block_request_init (request, swap_device, slot_idx * SLOT_SIZE, SLOT_SIZE,
+                      kpage, false, NULL, NULL);
+  if (zswap_load (slot_idx, kpage))
+    sema_up (&request->done);
+  else
+    block_submit (request);
+  return true;
 }
 
 /* If the slot is valid, transter the data from the swap partition to the given
@@ -58,22 +159,36 @@ swap_out (const void *kpage)
 bool
 swap_in (slot_id slot_idx, void *kpage)
 {
-  lock_acquire (&swap_lock);
-  bool failed = false;
-  if (slot_idx >= bitmap_size (swap_bitmap))
-    failed = true;
-  if (bitmap_test (swap_bitmap, slot_idx) == false)
-    failed = true;
-  lock_release (&swap_lock);
-  if (failed)
+  struct block_request request;
+  if (!swap_read (slot_idx, kpage, &request))
     return false;
+  block_wait (&request);
+  swap_free (slot_idx);
+  return true;
+}
 
-  for (int i = 0; i < SLOT_SIZE; i++)
-    block_read (swap_device, slot_idx * SLOT_SIZE + i,
-                kpage + i * BLOCK_SECTOR_SIZE);
+/* Finds the other slots in SLOT_IDX's cluster that still hold
+   pages swapped out by process OWNER.  Stores up to MAX of them
+   into SLOTS, with their user virtual addresses in UPAGES, and
+   returns the number stored. */
+size_t
+swap_cluster (slot_id slot_idx, tid_t owner, slot_id slots[], void *upages[],
+              size_t max)
+{
+  size_t cnt = 0;
 
   lock_acquire (&swap_lock);
-  bitmap_set (swap_bitmap, slot_idx, false);
+  ASSERT (slot_idx < bitmap_size (swap_bitmap));
+  slot_id first = slot_info[slot_idx].cluster;
+  slot_id end = first + slot_info[slot_idx].cluster_cnt;
+  for (slot_id i = first; i < end && cnt < max; i++)
+    if (i != slot_idx && bitmap_test (swap_bitmap, i)
+        && slot_info[i].cluster == first && slot_info[i].owner == owner)
+      {
+        slots[cnt] = i;
+        upages[cnt] = slot_info[i].upage;
+        cnt++;
+      }
   lock_release (&swap_lock);
-  return true;
+  return cnt;
 }
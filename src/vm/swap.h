@@ -1,6 +1,9 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+#include "devices/block.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -10,8 +13,19 @@
 typedef size_t slot_id;
 #define SLOT_ERR SIZE_MAX
 
+/* The number of sectors a slot occupies. */
+#define SLOT_SIZE (PGSIZE / BLOCK_SECTOR_SIZE)
+
 void swap_init (void);
-slot_id swap_out (const void *kpage);
+slot_id swap_alloc (size_t cnt);
+void swap_free (slot_id slot_idx);
+void swap_free_many (const slot_id *, size_t cnt);
+void swap_write (slot_id slot_idx, const void *kpage, tid_t owner,
+                 void *upage, struct block_request *, block_complete_func *,
+                 void *aux);
+bool swap_read (slot_id slot_idx, void *kpage, struct block_request *);
 bool swap_in (slot_id slot_idx, void *kpage);
+size_t swap_cluster (slot_id slot_idx, tid_t owner, slot_id slots[],
+                     void *upages[], size_t max);
 
 #endif /* vm/swap.h */
@@ -0,0 +1,224 @@
+#include "vm/zswap.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <lz.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+
+/* A pool of compressed pages in kernel memory, in front of the
+   swap partition.  A page written to a swap slot is compressed
+   into the pool instead, if it compresses well, and only reaches
+   the slot on disk when the pool fills up and it is the oldest
+   page there.  Reading a slot checks the pool first.
+
+   The pool is a run of kernel pages divided into blocks, and each
+   compressed page takes consecutive blocks, found with a bitmap. */
+
+/* Size of a block of the pool, in bytes. */
+#define BLOCK_SIZE 64
+
+/* Pages that don't compress to this size or smaller go straight
+   to disk. */
+#define MAX_STORED (PGSIZE * 3 / 4)
+
+size_t zswap_pages;
+
+/* A compressed page in the pool. */
+struct entry
+{
+  slot_id slot;          /* Swap slot that the page belongs to. */
+  size_t block;          /* First block in the pool. */
+  size_t len;            /* Length of the compressed data in bytes. */
+  struct list_elem elem; /* Element in lru_list. */
+};
+
+/* Everything below is protected by zswap_lock. */
+static struct lock zswap_lock;
+static struct block *swap_device;
+static uint8_t *pool;                /* The pool, or null if disabled. */
+static struct bitmap *used_blocks;   /* Blocks in use. */
+static struct entry **slot_entries;  /* Entry for each slot, or null. */
+static struct list lru_list;         /* Entries, oldest first. */
+static uint8_t compressed[PGSIZE];   /* Output of lz_compress(). */
+static uint8_t work[LZ_WORK_SIZE];   /* Scratch space for lz_compress(). */
+static void *bounce;                 /* Page for writing back to disk. */
+
+/* Statistics. */
+static unsigned long long store_cnt;     /* Pages stored. */
+static unsigned long long reject_cnt;    /* Pages that didn't compress. */
+static unsigned long long load_cnt;      /* Pages read from the pool. */
+static unsigned long long writeback_cnt; /* Pages written to disk. */
+
+static void write_back_oldest (void);
+static void remove_entry (struct entry *);
+
+/* Initializes the compressed pool for the SLOT_CNT slots of
+   SWAP_DEVICE, with zswap_pages pages of kernel memory.  Leaves
+   it disabled if zswap_pages is 0 or memory is short. */
+void
+zswap_init (struct block *device, size_t slot_cnt)
+{
+  lock_init (&zswap_lock);
+  list_init (&lru_list);
+  swap_device = device;
+  if (zswap_pages == 0)
+    return;
+
+  pool = palloc_get_multiple (0, zswap_pages);
+  used_blocks = bitmap_create (zswap_pages * PGSIZE / BLOCK_SIZE);
+  slot_entries = calloc (slot_cnt, sizeof *slot_entries);
+  bounce = palloc_get_page (0);
+  if (pool == NULL || used_blocks == NULL || slot_entries == NULL
+      || bounce == NULL)
+    {
+      printf ("zswap: not enough memory for %zu pages, disabled\n",
+              zswap_pages);
+      if (pool != NULL)
+        palloc_free_multiple (pool, zswap_pages);
+      if (used_blocks != NULL)
+        bitmap_destroy (used_blocks);
+      free (slot_entries);
+      palloc_free_page (bounce);
+      pool = NULL;
+      return;
+    }
+}
+
+/* Compresses the page at KPAGE into the pool as the contents of
+   slot SLOT, writing the oldest pages in the pool back to disk if
+   there is no room.  Returns true if successful, false if the
+   pool is disabled or the page doesn't compress well enough, in
+   which case the caller must write it to disk itself. */
+bool
+zswap_store (slot_id slot, const void *kpage)
+{
+  if (pool == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  ASSERT (slot_entries[slot] == NULL);
+  size_t len = lz_compress (kpage, PGSIZE, compressed, MAX_STORED, work);
+  if (len == 0)
+    {
+      reject_cnt++;
+      lock_release (&zswap_lock);
+      return false;
+    }
+
+  struct entry *e = malloc (sizeof *e);
+  if (e == NULL)
+    {
+      lock_release (&zswap_lock);
+      return false;
+    }
+
+  size_t block_cnt = DIV_ROUND_UP (len, BLOCK_SIZE);
+  size_t block;
+  while ((block = bitmap_scan_and_flip (used_blocks, 0, block_cnt, false))
+         == BITMAP_ERROR)
+    {
+      if (list_empty (&lru_list))
+        {
+          free (e);
+          lock_release (&zswap_lock);
+          return false;
+        }
+      write_back_oldest ();
+    }
+
+  memcpy (pool + block * BLOCK_SIZE, compressed, len);
+  e->slot = slot;
+  e->block = block;
+  e->len = len;
+  list_push_back (&lru_list, &e->elem);
+  slot_entries[slot] = e;
+  store_cnt++;
+  lock_release (&zswap_lock);
+  return true;
+}
+
+/* If slot SLOT's contents are in the pool, decompresses them into
+   KPAGE and returns true.  Otherwise, returns false.  The page
+   stays in the pool until the slot is freed. */
+bool
+zswap_load (slot_id slot, void *kpage)
+{
+  if (pool == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  struct entry *e = slot_entries[slot];
+  if (e != NULL)
+    {
+      if (!lz_decompress (pool + e->block * BLOCK_SIZE, e->len, kpage,
+                          PGSIZE))
+        PANIC ("zswap: slot %zu is corrupt", slot);
+      load_cnt++;
+    }
+  lock_release (&zswap_lock);
+  return e != NULL;
+}
+
+/* Drops slot SLOT's contents from the pool, if they are there,
+   because the slot is being freed. */
+void
+zswap_invalidate (slot_id slot)
+{
+  if (pool == NULL)
+    return;
+
+  lock_acquire (&zswap_lock);
+  if (slot_entries[slot] != NULL)
+    remove_entry (slot_entries[slot]);
+  lock_release (&zswap_lock);
+}
+
+/* Prints statistics for the pool. */
+void
+zswap_print_stats (void)
+{
+  if (pool == NULL)
+    return;
+  printf ("Zswap: %llu pages stored, %llu rejected, %llu loaded, "
+          "%llu written back\n",
+          store_cnt, reject_cnt, load_cnt, writeback_cnt);
+}
+
+/* Writes the oldest page in the pool to its slot on disk and
+   removes it from the pool. */
+static void
+write_back_oldest (void)
+{
+  ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+  struct entry *e = list_entry (list_front (&lru_list), struct entry, elem);
+  if (!lz_decompress (pool + e->block * BLOCK_SIZE, e->len, bounce, PGSIZE))
+    PANIC ("zswap: slot %zu is corrupt", e->slot);
+
+  struct block_request request;
+  block_request_init (&request, swap_device, e->slot * SLOT_SIZE, SLOT_SIZE,
+                      bounce, true, NULL, NULL);
+  block_submit (&request);
+  block_wait (&request);
+  writeback_cnt++;
+  remove_entry (e);
+}
+
+/* Removes E from the pool and frees it. */
+static void
+remove_entry (struct entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+  bitmap_set_multiple (used_blocks, e->block, DIV_ROUND_UP (e->len, BLOCK_SIZE),
+                       false);
+  list_remove (&e->elem);
+  slot_entries[e->slot] = NULL;
+  free (e);
+}
@@ -0,0 +1,19 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include "devices/block.h"
+#include "vm/swap.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Number of kernel pages in the compressed pool, set by the
+   "-zswap" kernel option.  0 disables the pool. */
+extern size_t zswap_pages;
+
+void zswap_init (struct block *swap_device, size_t slot_cnt);
+bool zswap_store (slot_id, const void *kpage);
+bool zswap_load (slot_id, void *kpage);
+void zswap_invalidate (slot_id);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */